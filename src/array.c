@@ -40,6 +40,15 @@ int array_length(void *array)
     return (array != NULL) ? ARRAY_OCCUPIED(array) : 0;
 }
 
+void array_clear(void *array)
+{
+    // Keep the allocation around so the array can be refilled without reallocating
+    if (array != NULL)
+    {
+        ARRAY_OCCUPIED(array) = 0;
+    }
+}
+
 void array_free(void *array)
 {
     if (array != NULL)
@@ -10,6 +10,7 @@
 
 void *array_hold(void *array, int count, int item_size);
 int array_length(void *array);
+void array_clear(void *array);
 void array_free(void *array);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+#define _XOPEN_SOURCE 700 // realpath, stat, strdup
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "asset.h"
+#include "array.h"
+
+// Dynamic array of every asset loaded since startup; indices stay valid
+static asset_t *assets = NULL;
+
+static bool get_file_identity(const char *filename, asset_t *asset)
+{
+    struct stat file;
+    if (stat(filename, &file) != 0)
+        return false;
+
+    asset->device = (uint64_t)file.st_dev;
+    asset->inode = (uint64_t)file.st_ino;
+    asset->size = (int64_t)file.st_size;
+    asset->mtime = (int64_t)file.st_mtime;
+    return true;
+}
+
+static bool same_file(const asset_t *a, const asset_t *b)
+{
+    return a->type == b->type && a->device == b->device && a->inode == b->inode &&
+           a->size == b->size && a->mtime == b->mtime;
+}
+
+int acquire_asset(asset_type_t type, const char *filename)
+{
+    asset_t identity = {.type = type};
+    if (filename == NULL || !get_file_identity(filename, &identity))
+        return -1;
+
+    for (int i = 0; i < array_length(assets); i++)
+    {
+        if (assets[i].references > 0 && same_file(&assets[i], &identity))
+        {
+            assets[i].references++;
+            return i;
+        }
+    }
+    return -1;
+}
+
+int register_asset(asset_type_t type, const char *filename, size_t memory, float load_ms)
+{
+    asset_t asset = {.type = type, .references = 1, .memory = memory, .load_ms = load_ms};
+    if (filename == NULL || !get_file_identity(filename, &asset))
+        return -1;
+
+    // A released entry of the same file is loaded again in place
+    int index = -1;
+    for (int i = 0; i < array_length(assets) && index < 0; i++)
+    {
+        if (assets[i].references == 0 && same_file(&assets[i], &asset))
+            index = i;
+    }
+    if (index < 0)
+    {
+        char *path = realpath(filename, NULL);
+        asset.path = path != NULL ? path : strdup(filename);
+        array_push(assets, asset);
+        return array_length(assets) - 1;
+    }
+
+    asset.path = assets[index].path;
+    assets[index] = asset;
+    return index;
+}
+
+asset_t *get_asset(int index)
+{
+    return &assets[index];
+}
+
+bool release_asset(int index)
+{
+    asset_t *asset = &assets[index];
+    if (--asset->references > 0)
+        return false;
+
+    memset(&asset->geometry, 0, sizeof(asset->geometry));
+    asset->texture = NULL;
+    return true;
+}
+
+void print_asset_report(void)
+{
+    size_t total_memory = 0;
+    float total_load_ms = 0;
+    printf("%-8s %4s %10s %9s  %s\n", "type", "refs", "memory KB", "load ms", "path");
+    for (int i = 0; i < array_length(assets); i++)
+    {
+        const asset_t *asset = &assets[i];
+        if (asset->references == 0)
+            continue;
+
+        printf("%-8s %4d %10.1f %9.2f  %s\n", asset->type == ASSET_GEOMETRY ? "geometry" : "texture",
+               asset->references, asset->memory / 1024.0, asset->load_ms, asset->path);
+        total_memory += asset->memory;
+        total_load_ms += asset->load_ms;
+    }
+    printf("%-8s %4s %10.1f %9.2f\n", "total", "", total_memory / 1024.0, total_load_ms);
+}
+
+void free_assets(void)
+{
+    for (int i = 0; i < array_length(assets); i++)
+        free(assets[i].path);
+    array_free(assets);
+    assets = NULL;
+}
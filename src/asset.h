@@ -0,0 +1,57 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mesh.h"
+#include "texture.h"
+
+////////////////////////////////////////////////////////////////////
+// Registry of the files meshes are loaded from. Each OBJ and PNG is
+// loaded once however many meshes use it. Entries are matched by the
+// identity of the file (device, inode, size and modification time),
+// so different spellings of a path share one entry and a file that
+// changed on disk is loaded again. An entry counts the meshes holding
+// it; the mesh releasing the last reference frees the data.
+////////////////////////////////////////////////////////////////////
+typedef enum
+{
+    ASSET_GEOMETRY,
+    ASSET_TEXTURE
+} asset_type_t;
+
+typedef struct
+{
+    asset_type_t type;
+    char *path;      // Canonical path of the file
+    uint64_t device; // File identity
+    uint64_t inode;
+    int64_t size;
+    int64_t mtime;
+    int references;  // Meshes holding the asset, 0 once the data was freed
+    size_t memory;   // Bytes of loaded data
+    float load_ms;   // Time spent loading and processing the file
+    mesh_t geometry; // ASSET_GEOMETRY: vertices, levels of detail, bounds and report
+    texture_t *texture; // ASSET_TEXTURE: decoded image
+} asset_t;
+
+// Index of the loaded asset of a file, after taking a reference to it,
+// or -1 when the file has not been loaded yet
+int acquire_asset(asset_type_t type, const char *filename);
+
+// Record a file that was just loaded, with one reference; -1 when the
+// file cannot be identified and the data stays private to the caller
+int register_asset(asset_type_t type, const char *filename, size_t memory, float load_ms);
+
+asset_t *get_asset(int index);
+
+// Drop a reference; true when it was the last one and the caller must free the data
+bool release_asset(int index);
+
+// Print one line per loaded asset with its references, memory and load time
+void print_asset_report(void);
+
+void free_assets(void);
+
+#endif
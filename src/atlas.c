@@ -0,0 +1,284 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atlas.h"
+#include "array.h"
+#include "mesh.h"
+#include "stream.h"
+#include "texture.h"
+#include "trace.h"
+
+typedef struct
+{
+    texture_t *texture;
+    bool packed;
+    int page;
+    int x; // Position of the first texel in the page
+    int y;
+} atlas_entry_t;
+
+// Top edge of the packed texels over [x, x + width) of a page
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+} skyline_segment_t;
+
+static bool atlas_enabled = false;
+static bool atlas_built = false;
+
+// Dynamic array of the page textures, owned by the atlas
+static texture_t **pages = NULL;
+
+void init_texture_atlas(bool enabled)
+{
+    atlas_enabled = enabled;
+    atlas_built = false;
+}
+
+// Packed entries first, taller textures first among them, then wider ones
+static int compare_entries(const void *a, const void *b)
+{
+    const atlas_entry_t *entry_a = a;
+    const atlas_entry_t *entry_b = b;
+    if (entry_a->packed != entry_b->packed)
+        return entry_a->packed ? -1 : 1;
+    if (entry_a->texture->height != entry_b->texture->height)
+        return entry_b->texture->height - entry_a->texture->height;
+    return entry_b->texture->width - entry_a->texture->width;
+}
+
+////////////////////////////////////////////////////////////////////
+// Lowest spot of the skyline a width x height texture fits, resting on
+// the highest segment under it, leftmost on ties. Returns false when
+// the texture does not fit the page any more.
+////////////////////////////////////////////////////////////////////
+static bool find_skyline_spot(skyline_segment_t *skyline, int page_width, int width, int height, int *x, int *y)
+{
+    int best_top = INT_MAX;
+    for (int i = 0; i < array_length(skyline) && skyline[i].x + width <= page_width; i++)
+    {
+        int top = 0;
+        for (int j = i; j < array_length(skyline) && skyline[j].x < skyline[i].x + width; j++)
+            top = skyline[j].y > top ? skyline[j].y : top;
+        if (top + height <= ATLAS_MAX_PAGE_HEIGHT && top + height < best_top)
+        {
+            best_top = top + height;
+            *x = skyline[i].x;
+            *y = top;
+        }
+    }
+    return best_top != INT_MAX;
+}
+
+// Append a segment, merged into the last one when both are at the same height
+static void push_segment(skyline_segment_t **skyline, skyline_segment_t segment)
+{
+    int last = array_length(*skyline) - 1;
+    if (last >= 0 && (*skyline)[last].y == segment.y)
+        (*skyline)[last].width += segment.width;
+    else
+        array_push(*skyline, segment);
+}
+
+// Raise the skyline over a texture placed at (x, y), which starts a segment
+static skyline_segment_t *add_to_skyline(skyline_segment_t *skyline, int x, int y, int width, int height)
+{
+    skyline_segment_t *raised = NULL;
+    skyline_segment_t placed = {x, y + height, width};
+    bool added = false;
+    for (int i = 0; i < array_length(skyline); i++)
+    {
+        skyline_segment_t segment = skyline[i];
+        int end = segment.x + segment.width;
+        if (end <= x)
+        {
+            push_segment(&raised, segment);
+            continue;
+        }
+        if (!added)
+        {
+            push_segment(&raised, placed);
+            added = true;
+        }
+        // Keep what sticks out to the right of the texture
+        if (end > x + width)
+        {
+            skyline_segment_t rest = {segment.x > x + width ? segment.x : x + width, segment.y, 0};
+            rest.width = end - rest.x;
+            push_segment(&raised, rest);
+        }
+    }
+    array_free(skyline);
+    return raised;
+}
+
+////////////////////////////////////////////////////////////////////
+// Place the sorted entries on pages page_width wide, starting a new
+// page when a texture fits nowhere on the current one. Fills the page
+// heights and returns the texels all pages take.
+////////////////////////////////////////////////////////////////////
+static size_t pack_entries(atlas_entry_t *entries, int num_entries, int page_width, int **page_heights)
+{
+    skyline_segment_t empty = {0, 0, page_width};
+    skyline_segment_t *skyline = NULL;
+    array_push(skyline, empty);
+    array_clear(*page_heights);
+    array_push(*page_heights, 0);
+
+    size_t texels = 0;
+    for (int e = 0; e < num_entries; e++)
+    {
+        int width = entries[e].texture->width;
+        int height = entries[e].texture->height;
+        int x, y;
+        if (!find_skyline_spot(skyline, page_width, width, height, &x, &y))
+        {
+            texels += (size_t)page_width * (*page_heights)[array_length(*page_heights) - 1];
+            array_clear(skyline);
+            array_push(skyline, empty);
+            array_push(*page_heights, 0);
+            x = y = 0;
+        }
+
+        int page = array_length(*page_heights) - 1;
+        entries[e].page = page;
+        entries[e].x = x;
+        entries[e].y = y;
+        skyline = add_to_skyline(skyline, x, y, width, height);
+        if (y + height > (*page_heights)[page])
+            (*page_heights)[page] = y + height;
+    }
+    texels += (size_t)page_width * (*page_heights)[array_length(*page_heights) - 1];
+    array_free(skyline);
+    return texels;
+}
+
+// Copy the rows of a texture into its place in a page
+static void copy_into_page(uint32_t *page_texels, int page_width, const atlas_entry_t *entry)
+{
+    const texture_t *texture = entry->texture;
+    for (int y = 0; y < texture->height; y++)
+        memcpy(&page_texels[(entry->y + y) * page_width + entry->x], &texture->texels[y * texture->width],
+               sizeof(uint32_t) * texture->width);
+}
+
+void build_texture_atlas(void)
+{
+    if (!atlas_enabled || atlas_built || !is_streaming_complete())
+        return;
+    atlas_built = true;
+
+    // One entry per registered texture, however many meshes share it
+    atlas_entry_t *entries = NULL;
+    for (int i = 0; i < get_num_meshes(); i++)
+    {
+        mesh_t *mesh = get_mesh(i);
+        if (mesh->texture == NULL || mesh->texture->index < 0)
+            continue;
+
+        int e = 0;
+        while (e < array_length(entries) && entries[e].texture != mesh->texture)
+            e++;
+        if (e == array_length(entries))
+        {
+            texture_t *texture = mesh->texture;
+            atlas_entry_t entry = {
+                .texture = texture,
+                .packed = texture->format == TEXTURE_RGBA && texture->texels != NULL && texture->page == texture->index &&
+                          texture->width <= ATLAS_PAGE_WIDTH && texture->height <= ATLAS_MAX_PAGE_HEIGHT};
+            array_push(entries, entry);
+        }
+    }
+
+    int num_packed = 0;
+    int widest = 0;
+    for (int e = 0; e < array_length(entries); e++)
+    {
+        num_packed += entries[e].packed;
+        if (entries[e].packed && entries[e].texture->width > widest)
+            widest = entries[e].texture->width;
+    }
+    if (num_packed < 2)
+    {
+        array_free(entries);
+        return;
+    }
+
+    TRACE_BEGIN("build_texture_atlas");
+    qsort(entries, array_length(entries), sizeof(atlas_entry_t), compare_entries);
+
+    // The page width needing the fewest pages, then leaving the fewest unused
+    // texels, the narrowest on ties
+    int *page_heights = NULL;
+    int best_width = widest;
+    int best_pages = INT_MAX;
+    size_t best_texels = SIZE_MAX;
+    for (int width = widest;; width += ATLAS_WIDTH_STEP)
+    {
+        if (width > ATLAS_PAGE_WIDTH)
+            width = ATLAS_PAGE_WIDTH;
+        size_t texels = pack_entries(entries, num_packed, width, &page_heights);
+        int num_pages = array_length(page_heights);
+        if (num_pages < best_pages || (num_pages == best_pages && texels < best_texels))
+        {
+            best_pages = num_pages;
+            best_texels = texels;
+            best_width = width;
+        }
+        if (width == ATLAS_PAGE_WIDTH)
+            break;
+    }
+    pack_entries(entries, num_packed, best_width, &page_heights);
+
+    for (int p = 0; p < array_length(page_heights); p++)
+    {
+        uint32_t *texels = calloc((size_t)best_width * page_heights[p], sizeof(uint32_t));
+        texture_t *page = calloc(1, sizeof(texture_t));
+        if (texels == NULL || page == NULL)
+        {
+            free(texels);
+            free(page);
+            break;
+        }
+        page->width = best_width;
+        page->height = page_heights[p];
+        page->format = TEXTURE_RGBA;
+        page->texels = texels;
+        page->index = -1;
+        if (register_texture(page) < 0)
+        {
+            free(texels);
+            free(page);
+            break;
+        }
+        array_push(pages, page);
+
+        for (int e = 0; e < num_packed; e++)
+        {
+            if (entries[e].page == p)
+            {
+                copy_into_page(texels, best_width, &entries[e]);
+                move_texture_to_atlas(entries[e].texture, page, entries[e].x, entries[e].y);
+            }
+        }
+    }
+    TRACE_END("build_texture_atlas");
+
+    array_free(page_heights);
+    array_free(entries);
+}
+
+void free_texture_atlas(void)
+{
+    for (int p = 0; p < array_length(pages); p++)
+    {
+        free((void *)pages[p]->texels);
+        free_texture(pages[p]);
+    }
+    array_free(pages);
+    pages = NULL;
+    atlas_built = false;
+}
@@ -0,0 +1,31 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Texture atlas. Once every mesh of the scene has its texture, the
+// RGBA textures are packed into a few pages, which are registered as
+// textures of their own, and the texels of the packed textures are
+// released. Triangles of every mesh packed into a page sample that
+// page, and wrap their uv inside the texture's rectangle of it.
+//
+// Textures are placed on a skyline, tallest first, each at the lowest
+// spot it fits. Page widths from the widest texture up to
+// ATLAS_PAGE_WIDTH are tried, and the one needing the fewest pages,
+// then leaving the fewest unused texels, is kept. A page is only as
+// tall as its highest texture.
+////////////////////////////////////////////////////////////////////
+#define ATLAS_PAGE_WIDTH 2048
+#define ATLAS_MAX_PAGE_HEIGHT 2048
+#define ATLAS_WIDTH_STEP 16 // Granularity of the page widths tried
+
+void init_texture_atlas(bool enabled);
+
+// Pack the scene textures, once every streamed mesh is textured;
+// called once per frame, does nothing after the atlas is built
+void build_texture_atlas(void);
+
+void free_texture_atlas(void);
+
+#endif
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "camera.h"
+#include "display.h"
+#include "stats.h"
+
+typedef struct
+{
+    vec3_t position;
+    float yaw;
+    float pitch;
+} camera_keyframe_t;
+
+////////////////////////////////////////////////////////////////////
+// Camera path flown by the benchmark. It approaches the jets, circles
+// around the runway looking back at them and returns to the start, so
+// every run sees the same mix of near, far and clipped geometry.
+////////////////////////////////////////////////////////////////////
+static const camera_keyframe_t camera_path[] = {
+    {{0.0, 0.0, 0.0}, 0.0, 0.0},
+    {{0.0, 0.5, 3.0}, 0.2, -0.2},
+    {{3.0, 0.8, 8.0}, -0.8, -0.3},
+    {{1.0, 1.5, 16.0}, -2.8, -0.3},
+    {{-3.0, 0.6, 10.0}, 1.3, -0.2},
+    {{-1.0, 0.3, 2.0}, 0.4, -0.1},
+    {{0.0, 0.0, 0.0}, 0.0, 0.0}};
+#define NUM_CAMERA_KEYFRAMES (int)(sizeof(camera_path) / sizeof(camera_path[0]))
+
+static uint64_t *frame_times = NULL;
+static int num_frames_expected = 0;
+static int num_frames_recorded = 0;
+static frame_stats_t total_stats;
+
+void init_benchmark(int num_frames)
+{
+    num_frames_expected = num_frames;
+    num_frames_recorded = 0;
+    memset(&total_stats, 0, sizeof(total_stats));
+    frame_times = (uint64_t *)malloc(sizeof(uint64_t) * num_frames);
+}
+
+static float smoothstep(float t)
+{
+    return t * t * (3 - 2 * t);
+}
+
+void update_benchmark_camera(int frame)
+{
+    // Map the frame number to a segment of the path and a factor within it
+    float progress = (num_frames_expected > 1) ? (float)frame / (num_frames_expected - 1) : 0;
+    float segment_position = progress * (NUM_CAMERA_KEYFRAMES - 1);
+    int segment = (int)segment_position;
+    if (segment >= NUM_CAMERA_KEYFRAMES - 1)
+        segment = NUM_CAMERA_KEYFRAMES - 2;
+    float t = smoothstep(segment_position - segment);
+
+    const camera_keyframe_t *from = &camera_path[segment];
+    const camera_keyframe_t *to = &camera_path[segment + 1];
+
+    vec3_t position = vec3_add(from->position, vec3_mul(vec3_sub(to->position, from->position), t));
+    init_camera(position, vec3_new(0, 0, 1));
+    rotate_camera_yaw(from->yaw + (to->yaw - from->yaw) * t);
+    rotate_camera_pitch(from->pitch + (to->pitch - from->pitch) * t);
+}
+
+void record_benchmark_frame(uint64_t frame_time_ns)
+{
+    if (num_frames_recorded >= num_frames_expected)
+        return;
+
+    frame_times[num_frames_recorded++] = frame_time_ns;
+
+    frame_stats_t stats = get_frame_stats();
+    accumulate_frame_stats(&total_stats, &stats);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of an ascending sorted array, in milliseconds
+static double percentile_ms(const uint64_t *sorted, int count, double percent)
+{
+    int rank = (int)ceil(percent / 100.0 * count) - 1;
+    if (rank < 0)
+        rank = 0;
+    if (rank >= count)
+        rank = count - 1;
+    return sorted[rank] / 1e6;
+}
+
+bool write_benchmark_report(const char *csv_filename)
+{
+    int count = num_frames_recorded;
+    if (count == 0)
+    {
+        fprintf(stderr, "Benchmark recorded no frames.\n");
+        return false;
+    }
+
+    uint64_t total_ns = 0;
+    for (int i = 0; i < count; i++)
+        total_ns += frame_times[i];
+    qsort(frame_times, count, sizeof(uint64_t), compare_u64);
+
+    double total_s = total_ns / 1e9;
+    double mean_ms = (total_ns / 1e6) / count;
+
+    // Append to the CSV file when given (writing the header only once), otherwise use stdout
+    FILE *file = stdout;
+    bool write_header = true;
+    if (csv_filename != NULL)
+    {
+        FILE *existing = fopen(csv_filename, "r");
+        if (existing != NULL)
+        {
+            write_header = (fgetc(existing) == EOF);
+            fclose(existing);
+        }
+        file = fopen(csv_filename, "a");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Error opening %s for writing.\n", csv_filename);
+            return false;
+        }
+    }
+
+    // Pipeline counters are reported as per-frame averages
+    if (write_header)
+        fprintf(file, "frames,width,height,mean_ms,p50_ms,p95_ms,p99_ms,triangles_per_s,pixels_per_s,"
+                      "instances_submitted,instances_frustum_culled,instances_occlusion_culled,"
+                      "meshlets_submitted,meshlets_frustum_culled,meshlets_backface_culled,faces_submitted,faces_backface_culled,faces_frustum_rejected,faces_clipped,"
+                      "triangles_emitted,pixels_tested,pixels_depth_rejected,pixels_written\n");
+    fprintf(file, "%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.0f,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+            count, get_window_width(), get_window_height(),
+            mean_ms,
+            percentile_ms(frame_times, count, 50),
+            percentile_ms(frame_times, count, 95),
+            percentile_ms(frame_times, count, 99),
+            total_stats.triangles_rendered / total_s,
+            total_stats.pixels_written / total_s,
+            (double)total_stats.instances_submitted / count,
+            (double)total_stats.instances_frustum_culled / count,
+            (double)total_stats.instances_occlusion_culled / count,
+            (double)total_stats.meshlets_submitted / count,
+            (double)total_stats.meshlets_frustum_culled / count,
+            (double)total_stats.meshlets_backface_culled / count,
+            (double)total_stats.faces_submitted / count,
+            (double)total_stats.faces_backface_culled / count,
+            (double)total_stats.faces_frustum_rejected / count,
+            (double)total_stats.faces_clipped / count,
+            (double)total_stats.triangles_emitted / count,
+            (double)total_stats.pixels_tested / count,
+            (double)total_stats.pixels_depth_rejected / count,
+            (double)total_stats.pixels_written / count);
+
+    if (file != stdout)
+        fclose(file);
+    return true;
+}
+
+void free_benchmark(void)
+{
+    free(frame_times);
+    frame_times = NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Deterministic benchmark: a scripted camera flight over a fixed
+// scene, with per-frame timings reduced to percentiles at the end.
+////////////////////////////////////////////////////////////////////
+#define BENCH_DELTA_TIME (1.0 / 60.0)
+#define BENCHMARK_SCENE_FILE "./assets/benchmark.scene"
+
+void init_benchmark(int num_frames);
+
+void update_benchmark_camera(int frame);
+
+void record_benchmark_frame(uint64_t frame_time_ns);
+
+bool write_benchmark_report(const char *csv_filename);
+
+void free_benchmark(void);
+
+#endif
@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <math.h>
+#include "bvh.h"
+#include "array.h"
+#include "clipping.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "stats.h"
+#include "trace.h"
+
+typedef struct
+{
+    int mesh_index;
+    int instance_index;
+    int leaf;      // Node holding the reference
+    aabb_t bounds; // World space bounds of the instance
+} bvh_ref_t;
+
+////////////////////////////////////////////////////////////////////
+// Nodes are stored depth first, so children always come after their
+// parent and a reverse sweep over the array visits children first.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    aabb_t bounds;
+    int left;   // Child nodes, -1 for leaves
+    int right;
+    int parent; // -1 for the root
+    int first;  // First reference of a leaf
+    int count;  // Number of references of a leaf, 0 for inner nodes
+} bvh_node_t;
+
+typedef struct
+{
+    vec3_t normal;
+    float distance;
+} world_plane_t;
+
+static bvh_ref_t *refs = NULL;
+static bvh_node_t *nodes = NULL;
+static int *moved_refs = NULL; // References of instances moved since the last update
+static int built_version = -1;
+static int sort_axis = 0;
+
+static float vec3_component(vec3_t v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static aabb_t aabb_union(aabb_t a, aabb_t b)
+{
+    aabb_t result = {
+        vec3_new(fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y), fminf(a.min.z, b.min.z)),
+        vec3_new(fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y), fmaxf(a.max.z, b.max.z))};
+    return result;
+}
+
+static mesh_instance_t *get_ref_instance(const bvh_ref_t *ref)
+{
+    return &get_mesh(ref->mesh_index)->instances[ref->instance_index];
+}
+
+static int compare_ref_centroids(const void *a, const void *b)
+{
+    const bvh_ref_t *ref_a = (const bvh_ref_t *)a;
+    const bvh_ref_t *ref_b = (const bvh_ref_t *)b;
+    float centroid_a = vec3_component(ref_a->bounds.min, sort_axis) + vec3_component(ref_a->bounds.max, sort_axis);
+    float centroid_b = vec3_component(ref_b->bounds.min, sort_axis) + vec3_component(ref_b->bounds.max, sort_axis);
+    return (centroid_a > centroid_b) - (centroid_a < centroid_b);
+}
+
+static void compute_node_bounds(int index)
+{
+    bvh_node_t *node = &nodes[index];
+    if (node->count > 0)
+    {
+        node->bounds = refs[node->first].bounds;
+        for (int i = 1; i < node->count; i++)
+            node->bounds = aabb_union(node->bounds, refs[node->first + i].bounds);
+    }
+    else
+    {
+        node->bounds = aabb_union(nodes[node->left].bounds, nodes[node->right].bounds);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Top-down build splitting at the median centroid along the longest
+// axis of the centroid bounds
+////////////////////////////////////////////////////////////////////
+static int build_node(int first, int count, int parent)
+{
+    bvh_node_t node = {
+        .left = -1,
+        .right = -1,
+        .parent = parent,
+        .first = first,
+        .count = count};
+    int index = array_length(nodes);
+    array_push(nodes, node);
+
+    if (count <= BVH_MAX_LEAF_INSTANCES)
+    {
+        for (int i = 0; i < count; i++)
+            refs[first + i].leaf = index;
+        compute_node_bounds(index);
+        return index;
+    }
+
+    vec3_t centroid_min = vec3_add(refs[first].bounds.min, refs[first].bounds.max);
+    vec3_t centroid_max = centroid_min;
+    for (int i = 1; i < count; i++)
+    {
+        vec3_t centroid = vec3_add(refs[first + i].bounds.min, refs[first + i].bounds.max);
+        centroid_min = vec3_new(fminf(centroid_min.x, centroid.x), fminf(centroid_min.y, centroid.y), fminf(centroid_min.z, centroid.z));
+        centroid_max = vec3_new(fmaxf(centroid_max.x, centroid.x), fmaxf(centroid_max.y, centroid.y), fmaxf(centroid_max.z, centroid.z));
+    }
+    vec3_t size = vec3_sub(centroid_max, centroid_min);
+    sort_axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+    qsort(&refs[first], count, sizeof(bvh_ref_t), compare_ref_centroids);
+
+    int half = count / 2;
+    int left = build_node(first, half, index);
+    int right = build_node(first + half, count - half, index);
+
+    // The recursion may have moved the node array
+    nodes[index].left = left;
+    nodes[index].right = right;
+    nodes[index].count = 0;
+    compute_node_bounds(index);
+    return index;
+}
+
+static void rebuild_scene_bvh(void)
+{
+    array_clear(refs);
+    array_clear(nodes);
+    array_clear(moved_refs);
+
+    for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++)
+    {
+        mesh_t *mesh = get_mesh(mesh_index);
+        for (int i = 0; i < array_length(mesh->instances); i++)
+        {
+            bvh_ref_t ref = {
+                .mesh_index = mesh_index,
+                .instance_index = i,
+                .bounds = get_mesh_instance_bounds(mesh, &mesh->instances[i])};
+            array_push(refs, ref);
+            mesh->instances[i].moved = false;
+        }
+    }
+
+    if (array_length(refs) > 0)
+        build_node(0, array_length(refs), -1);
+
+    // The build sorted the references, point the instances at their final place
+    for (int r = 0; r < array_length(refs); r++)
+        get_ref_instance(&refs[r])->bvh_ref = r;
+}
+
+void mark_instance_moved(int mesh_index, int instance_index)
+{
+    mesh_instance_t *instance = &get_mesh(mesh_index)->instances[instance_index];
+    if (instance->moved)
+        return;
+
+    // Instances added since the last rebuild get their bounds from the next one
+    instance->moved = true;
+    if (instance->bvh_ref >= 0)
+        array_push(moved_refs, instance->bvh_ref);
+}
+
+static bool aabb_equal(aabb_t a, aabb_t b)
+{
+    return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+           a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+
+////////////////////////////////////////////////////////////////////
+// Refit keeps the tree topology and only recomputes the bounds of the
+// leaves holding moved instances and of their ancestors, so its cost
+// follows the number of moved instances rather than the scene size.
+// The walk up stops at the first node whose bounds did not change.
+// The tree gets looser as instances drift apart; a rebuild restores
+// its quality.
+////////////////////////////////////////////////////////////////////
+static void refit_scene_bvh(void)
+{
+    for (int i = 0; i < array_length(moved_refs); i++)
+    {
+        bvh_ref_t *ref = &refs[moved_refs[i]];
+        mesh_instance_t *instance = get_ref_instance(ref);
+        ref->bounds = get_mesh_instance_bounds(get_mesh(ref->mesh_index), instance);
+        instance->moved = false;
+
+        for (int n = ref->leaf; n >= 0; n = nodes[n].parent)
+        {
+            aabb_t old_bounds = nodes[n].bounds;
+            compute_node_bounds(n);
+            if (aabb_equal(old_bounds, nodes[n].bounds))
+                break;
+        }
+    }
+    array_clear(moved_refs);
+}
+
+void update_scene_bvh(void)
+{
+    if (built_version != get_mesh_table_version())
+    {
+        uint64_t build_start = profile_begin();
+        TRACE_BEGIN("bvh_build");
+        rebuild_scene_bvh();
+        built_version = get_mesh_table_version();
+        TRACE_END("bvh_build");
+        profile_end(PROFILE_BVH_BUILD, build_start);
+    }
+    else
+    {
+        uint64_t refit_start = profile_begin();
+        refit_scene_bvh();
+        profile_end(PROFILE_BVH_REFIT, refit_start);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Bring the camera space frustum planes into world space. With the
+// view matrix p_camera = R * p_world + t, a camera space plane through
+// q with normal n becomes (R^T * n) . p_world + n . (t - q) >= 0.
+////////////////////////////////////////////////////////////////////
+static void get_world_frustum_planes(mat4_t view_matrix, world_plane_t planes[NUM_PLANES])
+{
+    vec3_t t = vec3_new(view_matrix.m[0][3], view_matrix.m[1][3], view_matrix.m[2][3]);
+    for (int i = 0; i < NUM_PLANES; i++)
+    {
+        vec3_t n = frustum_planes[i].normal;
+        planes[i].normal = vec3_new(
+            view_matrix.m[0][0] * n.x + view_matrix.m[1][0] * n.y + view_matrix.m[2][0] * n.z,
+            view_matrix.m[0][1] * n.x + view_matrix.m[1][1] * n.y + view_matrix.m[2][1] * n.z,
+            view_matrix.m[0][2] * n.x + view_matrix.m[1][2] * n.y + view_matrix.m[2][2] * n.z);
+        planes[i].distance = vec3_dot(n, vec3_sub(t, frustum_planes[i].point));
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Test a box against the planes left in mask. Planes the box is fully
+// inside of are removed from mask, so descendants skip them.
+////////////////////////////////////////////////////////////////////
+static bool is_aabb_outside_planes(aabb_t bounds, const world_plane_t planes[NUM_PLANES], int *mask)
+{
+    vec3_t center = vec3_mul(vec3_add(bounds.min, bounds.max), 0.5);
+    vec3_t extents = vec3_mul(vec3_sub(bounds.max, bounds.min), 0.5);
+
+    for (int i = 0; i < NUM_PLANES; i++)
+    {
+        if (!(*mask & (1 << i)))
+            continue;
+
+        vec3_t n = planes[i].normal;
+        float distance = vec3_dot(n, center) + planes[i].distance;
+        float radius = fabsf(n.x) * extents.x + fabsf(n.y) * extents.y + fabsf(n.z) * extents.z;
+        if (distance + radius < 0)
+            return true;
+        if (distance - radius >= 0)
+            *mask &= ~(1 << i);
+    }
+    return false;
+}
+
+static int set_subtree_visible(int index, const world_plane_t planes[NUM_PLANES], int mask)
+{
+    const bvh_node_t *node = &nodes[index];
+    if (node->count == 0)
+        return set_subtree_visible(node->left, planes, mask) + set_subtree_visible(node->right, planes, mask);
+
+    int num_visible = 0;
+    for (int r = node->first; r < node->first + node->count; r++)
+    {
+        int ref_mask = mask;
+        if (ref_mask == 0 || !is_aabb_outside_planes(refs[r].bounds, planes, &ref_mask))
+        {
+            get_ref_instance(&refs[r])->visible = true;
+            num_visible++;
+        }
+    }
+    return num_visible;
+}
+
+void cull_scene_instances(mat4_t view_matrix)
+{
+    uint64_t cull_start = profile_begin();
+    TRACE_BEGIN("cull");
+
+    for (int r = 0; r < array_length(refs); r++)
+        get_ref_instance(&refs[r])->visible = false;
+
+    world_plane_t planes[NUM_PLANES];
+    get_world_frustum_planes(view_matrix, planes);
+
+    // Each stack entry carries the planes its parent was not fully inside of
+    int stack[64];
+    int stack_masks[64];
+    int stack_size = 0;
+    if (array_length(nodes) > 0)
+    {
+        stack[0] = 0;
+        stack_masks[0] = (1 << NUM_PLANES) - 1;
+        stack_size = 1;
+    }
+
+    int num_visible = 0;
+    while (stack_size > 0)
+    {
+        stack_size--;
+        int index = stack[stack_size];
+        int mask = stack_masks[stack_size];
+        const bvh_node_t *node = &nodes[index];
+
+        if (is_aabb_outside_planes(node->bounds, planes, &mask))
+            continue;
+
+        // Leaves test their instances, fully inside subtrees need no more tests
+        if (mask == 0 || node->count > 0)
+        {
+            num_visible += set_subtree_visible(index, planes, mask);
+            continue;
+        }
+
+        stack[stack_size] = node->left;
+        stack_masks[stack_size++] = mask;
+        stack[stack_size] = node->right;
+        stack_masks[stack_size++] = mask;
+    }
+
+    frame_stats.instances_submitted += array_length(refs);
+    frame_stats.instances_frustum_culled += array_length(refs) - num_visible;
+
+    TRACE_END("cull");
+    profile_end(PROFILE_CULL, cull_start);
+}
+
+void free_scene_bvh(void)
+{
+    array_free(refs);
+    array_free(nodes);
+    array_free(moved_refs);
+    refs = NULL;
+    nodes = NULL;
+    moved_refs = NULL;
+    built_version = -1;
+}
@@ -0,0 +1,25 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "matrix.h"
+
+////////////////////////////////////////////////////////////////////
+// Bounding volume hierarchy over the world space bounds of every mesh
+// instance. It is rebuilt when instances are added or removed and
+// refit when instances move, then traversed once per frame against
+// the view frustum to set the visible flag of each instance.
+////////////////////////////////////////////////////////////////////
+#define BVH_MAX_LEAF_INSTANCES 4
+
+// Rebuild or refit the hierarchy to match the current instances
+void update_scene_bvh(void);
+
+// Queue an instance whose transform changed for the next refit
+void mark_instance_moved(int mesh_index, int instance_index);
+
+// Mark the instances whose bounds intersect the frustum as visible
+void cull_scene_instances(mat4_t view_matrix);
+
+void free_scene_bvh(void);
+
+#endif
@@ -0,0 +1,94 @@
+#define _XOPEN_SOURCE 700 // realpath, mmap
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cachefile.h"
+
+uint64_t hash_fnv1a(const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    return hash;
+}
+
+void get_cache_filename(const char *directory, const char *source_filename, const char *extension,
+                        char *filename, size_t size)
+{
+    // The same file reached through ./, .. or a symbolic link shares one cache file
+    char canonical[PATH_MAX];
+    const char *path = realpath(source_filename, canonical) != NULL ? canonical : source_filename;
+    uint64_t hash = hash_fnv1a(path, strlen(path));
+
+    if (strncmp(source_filename, "./", 2) == 0)
+        source_filename += 2;
+
+    // Separators and dots become underscores, only the hash has to be unique
+    int length = snprintf(filename, size, "%s/", directory);
+    for (const char *c = source_filename; *c != '\0' && length + 1 < (int)size; c++)
+        filename[length++] = (*c == '/' || *c == '\\' || *c == '.') ? '_' : *c;
+    filename[length] = '\0';
+
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), "_%016llx.%s", (unsigned long long)hash, extension);
+    strncat(filename, suffix, size - strlen(filename) - 1);
+}
+
+void *map_file(const char *filename, size_t *size)
+{
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return NULL;
+
+    struct stat info;
+    void *mapping = NULL;
+    if (fstat(file, &info) == 0 && info.st_size > 0)
+    {
+        *size = (size_t)info.st_size;
+        mapping = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping == MAP_FAILED)
+            mapping = NULL;
+    }
+    close(file);
+    return mapping;
+}
+
+bool hash_source_file(const char *source_filename, int64_t *size, uint64_t *hash)
+{
+    size_t mapped_size;
+    void *source = map_file(source_filename, &mapped_size);
+    if (source == NULL)
+        return false;
+
+    *size = (int64_t)mapped_size;
+    *hash = hash_fnv1a(source, mapped_size);
+    munmap(source, mapped_size);
+    return true;
+}
+
+FILE *create_cache_file(const char *filename, char *temporary, size_t size)
+{
+    snprintf(temporary, size, "%s.tmp", filename);
+    FILE *file = fopen(temporary, "wb");
+    if (file == NULL)
+        fprintf(stderr, "Error writing cache file %s.\n", filename);
+    return file;
+}
+
+bool commit_cache_file(FILE *file, bool written, const char *temporary, const char *filename)
+{
+    // Runs that still have the old file open or mapped keep reading it after the rename
+    if (fclose(file) != 0 || !written || rename(temporary, filename) != 0)
+    {
+        fprintf(stderr, "Error writing cache file %s.\n", filename);
+        remove(temporary);
+        return false;
+    }
+    return true;
+}
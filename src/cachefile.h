@@ -0,0 +1,40 @@
+#ifndef CACHEFILE_H
+#define CACHEFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////
+// Naming, validation and writing shared by the mesh and texture
+// caches. Every source file maps to one flat file in the cache
+// directory. The file name keeps a readable copy of the source path,
+// followed by the FNV-1a hash of its canonical absolute path, which
+// keeps apart paths that the readable copy flattens to the same name
+// (a/b_c.png and a_b/c.png).
+//
+// A cache file records the size and FNV-1a hash of the bytes of its
+// source file, and is used for as long as both still match. Cache
+// files are written aside and renamed into place, so a reader never
+// sees a partly written file.
+////////////////////////////////////////////////////////////////////
+
+uint64_t hash_fnv1a(const void *data, size_t size);
+
+void get_cache_filename(const char *directory, const char *source_filename, const char *extension,
+                        char *filename, size_t size);
+
+// Map a whole file read-only, NULL when it is missing or empty
+void *map_file(const char *filename, size_t *size);
+
+// Size and FNV-1a hash of the bytes of a source file
+bool hash_source_file(const char *source_filename, int64_t *size, uint64_t *hash);
+
+// Open the temporary file a cache file is written to, NULL on failure
+FILE *create_cache_file(const char *filename, char *temporary, size_t size);
+
+// Close the temporary file and move it over the cache file, or remove it when written is false
+bool commit_cache_file(FILE *file, bool written, const char *temporary, const char *filename);
+
+#endif
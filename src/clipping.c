@@ -1,7 +1,7 @@
 #include <math.h>
 #include "clipping.h"
+#include "stats.h"
 
-#define NUM_PLANES 6
 plane_t frustum_planes[NUM_PLANES];
 
 ////////////////////////////////////////////////////////////////////
@@ -74,6 +74,9 @@ void triangles_from_polygon(polygon_t *polygon, triangle_t triangles[], int *num
         triangles[i].texcoords[2] = polygon->texcoords[index2];
     }
     *num_triangles = polygon->num_vertices - 2;
+
+    if (*num_triangles > 0)
+        frame_stats.triangles_emitted += *num_triangles;
 }
 
 float float_lerp(float a, float b, float t)
@@ -81,7 +84,7 @@ float float_lerp(float a, float b, float t)
     return a + t * (b - a);
 }
 
-void clip_polygon_against_plane(polygon_t *polygon, int plane)
+bool clip_polygon_against_plane(polygon_t *polygon, int plane)
 {
     // Get the clipping plane point and normal
     vec3_t plane_point = frustum_planes[plane].point;
@@ -91,6 +94,7 @@ void clip_polygon_against_plane(polygon_t *polygon, int plane)
     vec3_t inside_vertices[MAX_NUM_POLY_VERTICES];
     tex2_t inside_texcoords[MAX_NUM_POLY_VERTICES];
     int num_inside_vertices = 0;
+    bool any_outside = false;
 
     // Start current vertex with the first polygon vertex and texture coordinates
     vec3_t *current_vertex = &polygon->vertices[0];
@@ -141,6 +145,10 @@ void clip_polygon_against_plane(polygon_t *polygon, int plane)
             inside_texcoords[num_inside_vertices] = tex2_clone(current_texcoord);
             num_inside_vertices++;
         }
+        else
+        {
+            any_outside = true;
+        }
 
         // Move to the next vertex
         previous_dot = current_dot;
@@ -157,14 +165,23 @@ void clip_polygon_against_plane(polygon_t *polygon, int plane)
         polygon->texcoords[i] = tex2_clone(&inside_texcoords[i]);
     }
     polygon->num_vertices = num_inside_vertices;
+
+    return any_outside;
 }
 
 void clip_polygon(polygon_t *polygon)
 {
-    clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+    bool clipped = false;
+    clipped |= clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+
+    // Count faces that ended up fully outside separately from the ones that were cut
+    if (polygon->num_vertices < 3)
+        frame_stats.faces_frustum_rejected++;
+    else if (clipped)
+        frame_stats.faces_clipped++;
 }
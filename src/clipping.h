@@ -1,6 +1,7 @@
 #ifndef CLIPPING_H
 #define CLIPPING_H
 
+#include <stdbool.h>
 #include "triangle.h"
 #include "vector.h"
 
@@ -17,12 +18,17 @@ enum
     FAR_FRUSTUM_PLANE,
 };
 
+#define NUM_PLANES 6
+
 typedef struct
 {
     vec3_t point;
     vec3_t normal;
 } plane_t;
 
+// Camera space frustum planes, normals pointing inside the frustum
+extern plane_t frustum_planes[NUM_PLANES];
+
 typedef struct
 {
     vec3_t vertices[MAX_NUM_POLY_VERTICES];
@@ -40,6 +46,6 @@ void clip_polygon(polygon_t *polygon);
 
 void triangles_from_polygon(polygon_t *polygon, triangle_t triangles[], int *num_triangles);
 
-void clip_polygon_against_plane(polygon_t *polygon, int plane);
+bool clip_polygon_against_plane(polygon_t *polygon, int plane);
 
 #endif
\ No newline at end of file
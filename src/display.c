@@ -1,9 +1,26 @@
+#include <string.h>
 #include "display.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////
+// A display backend decides where a finished color buffer goes and
+// how the resources it owns are released.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    void (*present)(void);
+    void (*destroy)(void);
+} display_backend_t;
+
+static const display_backend_t *backend = NULL;
+static char *frame_output = NULL;
+static int frame_index = 0;
 
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 static uint32_t *color_buffer = NULL;
 static float *z_buffer = NULL;
+static uint16_t *overdraw_buffer = NULL;
 static SDL_Texture *color_buffer_texture = NULL;
 static int window_width = 320;
 static int window_height = 200;
@@ -63,6 +80,73 @@ bool should_render_wire_vertex(void)
     return (render_method == RENDER_WIRE_VERTEX);
 }
 
+bool should_render_overdraw(void)
+{
+    return (render_method == RENDER_OVERDRAW);
+}
+
+static bool allocate_buffers(void)
+{
+    // Allocate memory in bytes to hold color buffer and z buffer
+    color_buffer = (uint32_t *)malloc(sizeof(uint32_t) * window_width * window_height);
+    z_buffer = (float *)malloc(sizeof(float) * window_width * window_height);
+    overdraw_buffer = (uint16_t *)calloc(window_width * window_height, sizeof(uint16_t));
+
+    if (!color_buffer || !z_buffer || !overdraw_buffer)
+    {
+        fprintf(stderr, "Error allocating %dx%d frame buffers.\n", window_width, window_height);
+        return false;
+    }
+    return true;
+}
+
+static void save_frame(void)
+{
+    if (frame_output == NULL)
+        return;
+
+    char filename[1024];
+    snprintf(filename, sizeof(filename), frame_output, frame_index);
+    write_image(filename, color_buffer, window_width, window_height);
+}
+
+static void sdl_present(void)
+{
+    SDL_UpdateTexture(
+        color_buffer_texture,
+        NULL,
+        color_buffer,
+        (int)(window_width * sizeof(uint32_t)));
+    SDL_RenderCopy(
+        renderer,
+        color_buffer_texture,
+        NULL,
+        NULL);
+    SDL_RenderPresent(renderer);
+}
+
+static void sdl_destroy(void)
+{
+    SDL_DestroyTexture(color_buffer_texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+static const display_backend_t sdl_backend = {sdl_present, sdl_destroy};
+
+static void headless_present(void)
+{
+    // Nothing to show on screen, frames are either dumped to disk or discarded
+}
+
+static void headless_destroy(void)
+{
+    SDL_Quit();
+}
+
+static const display_backend_t headless_backend = {headless_present, headless_destroy};
+
 bool initialize_window(void)
 {
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
@@ -109,9 +193,10 @@ bool initialize_window(void)
     // Set Window to FullScreen
     SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
 
-    // Allocate memory in bytes to hold color buffer and z buffer
-    color_buffer = (uint32_t *)malloc(sizeof(uint32_t) * window_width * window_height);
-    z_buffer = (float *)malloc(sizeof(float) * window_width * window_height);
+    if (!allocate_buffers())
+    {
+        return false;
+    }
 
     // Create SDL texture used to display the color buffer
     color_buffer_texture = SDL_CreateTexture(
@@ -121,9 +206,46 @@ bool initialize_window(void)
         window_width,
         window_height);
 
+    backend = &sdl_backend;
+    return true;
+}
+
+bool initialize_headless_window(int width, int height)
+{
+    // Only the timer subsystem is needed, this works on machines without a display
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        fprintf(stderr, "Error initializing SDL timer.\n");
+        return false;
+    }
+
+    window_width = width;
+    window_height = height;
+
+    if (!allocate_buffers())
+    {
+        return false;
+    }
+
+    backend = &headless_backend;
     return true;
 }
 
+bool is_headless(void)
+{
+    return backend == &headless_backend;
+}
+
+void set_frame_output(char *filename_pattern)
+{
+    frame_output = filename_pattern;
+}
+
+uint32_t *get_color_buffer(void)
+{
+    return color_buffer;
+}
+
 void draw_grid(int spacing, bool fill_border, uint32_t grid_color)
 {
     for (int y = 0; y < window_height; y++)
@@ -195,17 +317,9 @@ void draw_rect(int x_pos, int y_pos, int width, int height, uint32_t color)
 
 void render_color_buffer(void)
 {
-    SDL_UpdateTexture(
-        color_buffer_texture,
-        NULL,
-        color_buffer,
-        (int)(window_width * sizeof(uint32_t)));
-    SDL_RenderCopy(
-        renderer,
-        color_buffer_texture,
-        NULL,
-        NULL);
-    SDL_RenderPresent(renderer);
+    save_frame();
+    backend->present();
+    frame_index++;
 }
 
 void clear_color_buffer(uint32_t color)
@@ -224,6 +338,72 @@ void clear_z_buffer(void)
     }
 }
 
+void clear_overdraw_buffer(void)
+{
+    memset(overdraw_buffer, 0, sizeof(uint16_t) * window_width * window_height);
+}
+
+void increment_overdraw_at(int x, int y)
+{
+    if (x < 0 || x >= window_width || y < 0 || y >= window_height)
+    {
+        return;
+    }
+
+    uint16_t *count = &overdraw_buffer[window_width * y + x];
+    if (*count < UINT16_MAX)
+        (*count)++;
+}
+
+////////////////////////////////////////////////////////////////////
+// Pack a color so its bytes are R,G,B,A in memory (RGBA32 format)
+////////////////////////////////////////////////////////////////////
+static uint32_t pack_rgba32(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    uint8_t bytes[4] = {r, g, b, a};
+    uint32_t color;
+    memcpy(&color, bytes, sizeof(color));
+    return color;
+}
+
+////////////////////////////////////////////////////////////////////
+// Heatmap of the overdraw buffer: black where nothing was drawn, then
+// blue, cyan, green, yellow, orange and red as coverage increases,
+// and white for 7 or more layers.
+////////////////////////////////////////////////////////////////////
+#define NUM_OVERDRAW_COLORS 8
+static const uint8_t overdraw_palette[NUM_OVERDRAW_COLORS][3] = {
+    {0, 0, 0},
+    {0, 0, 160},
+    {0, 160, 220},
+    {0, 200, 0},
+    {230, 230, 0},
+    {255, 140, 0},
+    {230, 0, 0},
+    {255, 255, 255}};
+
+void draw_overdraw_heatmap(void)
+{
+    uint32_t colors[NUM_OVERDRAW_COLORS];
+    for (int i = 0; i < NUM_OVERDRAW_COLORS; i++)
+        colors[i] = pack_rgba32(overdraw_palette[i][0], overdraw_palette[i][1], overdraw_palette[i][2], 0xFF);
+
+    for (int i = 0; i < window_width * window_height; i++)
+    {
+        int count = overdraw_buffer[i];
+        color_buffer[i] = colors[count < NUM_OVERDRAW_COLORS ? count : NUM_OVERDRAW_COLORS - 1];
+    }
+
+    // Legend with one swatch per coverage count along the bottom of the screen
+    int swatch_size = 12;
+    int y = window_height - swatch_size - 8;
+    for (int i = 1; i < NUM_OVERDRAW_COLORS; i++)
+    {
+        int x = 8 + (i - 1) * (swatch_size + 4);
+        draw_rect(x, y, swatch_size, swatch_size, colors[i]);
+    }
+}
+
 float get_z_buffer_at(int x, int y)
 {
     if (x < 0 || x >= window_width || y < 0 || y >= window_height)
@@ -247,7 +427,9 @@ void destroy_window(void)
 {
     free(color_buffer);
     free(z_buffer);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    free(overdraw_buffer);
+    if (backend != NULL)
+    {
+        backend->destroy();
+    }
 }
\ No newline at end of file
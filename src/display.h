@@ -21,10 +21,15 @@ enum render_method
     RENDER_FILL_TRIANGLE,
     RENDER_FILL_TRIANGLE_WIRE,
     RENDER_TEXTURED,
-    RENDER_TEXTURED_WIRE
+    RENDER_TEXTURED_WIRE,
+    RENDER_OVERDRAW
 };
 
 bool initialize_window(void);
+bool initialize_headless_window(int width, int height);
+bool is_headless(void);
+void set_frame_output(char *filename_pattern);
+uint32_t *get_color_buffer(void);
 int get_window_width(void);
 int get_window_height(void);
 
@@ -36,6 +41,7 @@ bool should_render_filled_triangle(void);
 bool should_render_textured_triangle(void);
 bool should_render_wireframe(void);
 bool should_render_wire_vertex(void);
+bool should_render_overdraw(void);
 
 void draw_grid(int spacing, bool fill_border, uint32_t grid_color);
 void draw_pixel(int x, int y, uint32_t color);
@@ -46,6 +52,10 @@ void draw_rect(int x_pos, int y_pos, int width, int height, uint32_t color);
 void render_color_buffer(void);
 void clear_color_buffer(uint32_t color);
 void clear_z_buffer(void);
+void clear_overdraw_buffer(void);
+
+void increment_overdraw_at(int x, int y);
+void draw_overdraw_heatmap(void);
 
 float get_z_buffer_at(int x, int y);
 void update_z_buffer_at(int x, int y, float value);
@@ -0,0 +1,16 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Fixed 5x7 bitmap font used for on-screen text overlays
+////////////////////////////////////////////////////////////////////
+#define FONT_GLYPH_WIDTH 5
+#define FONT_GLYPH_HEIGHT 7
+#define FONT_GLYPH_ADVANCE (FONT_GLYPH_WIDTH + 1)
+
+void draw_char(int x, int y, char c, uint32_t color, int scale);
+void draw_text(int x, int y, const char *text, uint32_t color, int scale);
+
+#endif
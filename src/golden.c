@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "golden.h"
+#include "array.h"
+#include "atlas.h"
+#include "bvh.h"
+#include "camera.h"
+#include "display.h"
+#include "image.h"
+#include "matrix.h"
+#include "mesh.h"
+#include "quantize.h"
+#include "texture.h"
+
+typedef struct
+{
+    char *name;
+    char *obj_filename;
+    char *png_filename; // NULL for meshes without a texture
+} golden_asset_t;
+
+typedef struct
+{
+    const char *name;
+    vec3_t rotation;
+    float distance; // Camera distance in multiples of the mesh bounding radius
+} golden_view_t;
+
+typedef struct
+{
+    const char *name;
+    int method;
+} golden_method_t;
+
+////////////////////////////////////////////////////////////////////
+// Optional load paths rendered again after the full precision pass
+// and compared against the same references, each with its own limits
+// on how far its approximations may move the frame.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    const char *name;
+    bool quantize_vertices;
+    bool compress_textures;
+    bool texture_atlas;
+    int tolerance;                // Largest per-channel difference still counted as a match
+    double max_mismatch_fraction; // Fraction of the pixels allowed over the tolerance
+} golden_variant_t;
+
+static const golden_asset_t golden_assets[] = {
+    {"crab", "./assets/crab.obj", "./assets/crab.png"},
+    {"cube", "./assets/cube.obj", "./assets/cube.png"},
+    {"drone", "./assets/drone.obj", "./assets/drone.png"},
+    {"efa", "./assets/efa.obj", "./assets/efa.png"},
+    {"f117", "./assets/f117.obj", "./assets/f117.png"},
+    {"f22", "./assets/f22.obj", "./assets/f22.png"},
+    {"minecraft_dirt", "./assets/minecraft_dirt.obj", "./assets/minecraft_dirt.png"},
+    {"runway", "./assets/runway.obj", "./assets/runway.png"},
+    {"shiba", "./assets/shiba.obj", NULL},
+    {"shiba_quad", "./assets/shiba_quad.obj", NULL},
+    {"sphere", "./assets/sphere.obj", NULL}};
+
+////////////////////////////////////////////////////////////////////
+// The camera stays at the origin looking down +z and the mesh is
+// placed in front of it. The close view puts the camera inside the
+// bounding sphere so the frustum clipping paths are exercised too.
+////////////////////////////////////////////////////////////////////
+static const golden_view_t golden_views[] = {
+    {"front", {0.0, 0.0, 0.0}, 2.0},
+    {"angle", {-0.5, 2.3, 0.2}, 2.0},
+    {"close", {-0.3, 0.8, 0.0}, 0.7}};
+
+static const golden_method_t golden_methods[] = {
+    {"wire_vertex", RENDER_WIRE_VERTEX},
+    {"wire", RENDER_WIRE},
+    {"fill", RENDER_FILL_TRIANGLE},
+    {"fill_wire", RENDER_FILL_TRIANGLE_WIRE},
+    {"textured", RENDER_TEXTURED},
+    {"textured_wire", RENDER_TEXTURED_WIRE},
+    {"overdraw", RENDER_OVERDRAW}};
+
+static const golden_variant_t golden_variants[] = {
+    {"quantize", true, false, false, GOLDEN_QUANTIZE_TOLERANCE, GOLDEN_QUANTIZE_MISMATCH_FRACTION},
+    {"compress", false, true, false, GOLDEN_COMPRESS_TOLERANCE, GOLDEN_COMPRESS_MISMATCH_FRACTION},
+    {"atlas", false, false, true, GOLDEN_ATLAS_TOLERANCE, GOLDEN_ATLAS_MISMATCH_FRACTION}};
+
+#define NUM_GOLDEN_ASSETS (int)(sizeof(golden_assets) / sizeof(golden_assets[0]))
+#define NUM_GOLDEN_VIEWS (int)(sizeof(golden_views) / sizeof(golden_views[0]))
+#define NUM_GOLDEN_METHODS (int)(sizeof(golden_methods) / sizeof(golden_methods[0]))
+#define NUM_GOLDEN_VARIANTS (int)(sizeof(golden_variants) / sizeof(golden_variants[0]))
+
+static void get_mesh_bounding_sphere(mesh_t *mesh, vec3_t *center, float *radius)
+{
+    int num_vertices = array_length(mesh->vertices);
+    vec3_t min = vec3_new(0, 0, 0);
+    vec3_t max = vec3_new(0, 0, 0);
+    for (int i = 0; i < num_vertices; i++)
+    {
+        vec3_t v = mesh->vertices[i].position;
+        if (i == 0 || v.x < min.x) min.x = v.x;
+        if (i == 0 || v.y < min.y) min.y = v.y;
+        if (i == 0 || v.z < min.z) min.z = v.z;
+        if (i == 0 || v.x > max.x) max.x = v.x;
+        if (i == 0 || v.y > max.y) max.y = v.y;
+        if (i == 0 || v.z > max.z) max.z = v.z;
+    }
+
+    *center = vec3_mul(vec3_add(min, max), 0.5);
+    *radius = 0;
+    for (int i = 0; i < num_vertices; i++)
+    {
+        float distance = vec3_length(vec3_sub(mesh->vertices[i].position, *center));
+        if (distance > *radius)
+            *radius = distance;
+    }
+}
+
+static int max_channel_difference(uint32_t a, uint32_t b)
+{
+    const unsigned char *pa = (const unsigned char *)&a;
+    const unsigned char *pb = (const unsigned char *)&b;
+    int max = 0;
+    for (int c = 0; c < 3; c++)
+    {
+        int difference = abs((int)pa[c] - (int)pb[c]);
+        if (difference > max)
+            max = difference;
+    }
+    return max;
+}
+
+////////////////////////////////////////////////////////////////////
+// Compare the current frame against a reference image. On failure a
+// diff image is written next to the reference: mismatching pixels in
+// red over a dimmed copy of the rendered frame.
+////////////////////////////////////////////////////////////////////
+static bool compare_with_reference(const char *reference_filename, const char *diff_filename, const char *label,
+                                   int tolerance, double max_mismatch_fraction)
+{
+    int width = get_window_width();
+    int height = get_window_height();
+    const uint32_t *frame = get_color_buffer();
+
+    int reference_width, reference_height;
+    uint32_t *reference = read_png(reference_filename, &reference_width, &reference_height);
+    if (reference == NULL)
+    {
+        printf("FAIL %s: missing reference (run with --golden-update on a known good build)\n", reference_filename);
+        return false;
+    }
+    if (reference_width != width || reference_height != height)
+    {
+        printf("FAIL %s: reference is %dx%d, frame is %dx%d\n", reference_filename, reference_width, reference_height, width, height);
+        free(reference);
+        return false;
+    }
+
+    int num_mismatches = 0;
+    int worst_difference = 0;
+    uint32_t *diff = (uint32_t *)malloc(sizeof(uint32_t) * width * height);
+    for (int i = 0; i < width * height; i++)
+    {
+        int difference = max_channel_difference(frame[i], reference[i]);
+        if (difference > worst_difference)
+            worst_difference = difference;
+
+        unsigned char rgba[4] = {0, 0, 0, 0xFF};
+        if (difference > tolerance)
+        {
+            num_mismatches++;
+            rgba[0] = 0xFF;
+        }
+        else
+        {
+            const unsigned char *actual = (const unsigned char *)&frame[i];
+            rgba[0] = rgba[1] = rgba[2] = (actual[0] + actual[1] + actual[2]) / 12;
+        }
+        memcpy(&diff[i], rgba, sizeof(uint32_t));
+    }
+
+    bool passed = num_mismatches <= (int)(max_mismatch_fraction * width * height);
+    if (!passed)
+    {
+        printf("FAIL %s%s: %d pixels differ by more than %d (worst %d), diff in %s\n",
+               reference_filename, label, num_mismatches, tolerance, worst_difference, diff_filename);
+        write_png(diff_filename, diff, width, height);
+    }
+
+    free(diff);
+    free(reference);
+    return passed;
+}
+
+typedef struct
+{
+    const char *reference_dir;
+    bool update_references;
+    golden_render_frame_fn render_frame;
+    int num_passed;
+    int num_failed;
+} golden_run_t;
+
+// Load an asset as mesh 0 with one instance; false when it has no faces
+static bool load_golden_mesh(const golden_asset_t *asset)
+{
+    free_meshes();
+    mesh_t *mesh = get_mesh(load_mesh(asset->obj_filename, asset->png_filename));
+    if (array_length(mesh->lods[0].faces) == 0)
+        return false;
+    add_mesh_instance(0, vec3_new(1, 1, 1), vec3_new(0, 0, 0), vec3_new(0, 0, 0));
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// Render the loaded mesh from every view in every method and write or
+// compare the frames. A variant pass (variant not NULL) labels its
+// failures and diff images with the variant name.
+////////////////////////////////////////////////////////////////////
+static void render_golden_views(golden_run_t *run, const golden_asset_t *asset, const golden_variant_t *variant,
+                                vec3_t center, float radius, int tolerance, double max_mismatch_fraction)
+{
+    char label[64] = "";
+    char diff_suffix[64] = "diff";
+    if (variant != NULL)
+    {
+        snprintf(label, sizeof(label), " (%s)", variant->name);
+        snprintf(diff_suffix, sizeof(diff_suffix), "%s.diff", variant->name);
+    }
+
+    mesh_t *mesh = get_mesh(0);
+    for (int v = 0; v < NUM_GOLDEN_VIEWS; v++)
+    {
+        const golden_view_t *view = &golden_views[v];
+
+        // Rotate the mesh about its center and push it away from the camera
+        // using the same rotation order as the world matrix
+        mat4_t rotation_matrix = mat4_make_rotation_z(view->rotation.z);
+        rotation_matrix = mat4_mul_mat4(mat4_make_rotation_y(view->rotation.y), rotation_matrix);
+        rotation_matrix = mat4_mul_mat4(mat4_make_rotation_x(view->rotation.x), rotation_matrix);
+        vec3_t rotated_center = vec3_from_vec4(mat4_mul_vec4(rotation_matrix, vec4_from_vec3(center)));
+
+        mesh_instance_t *instance = &mesh->instances[0];
+        instance->rotation = view->rotation;
+        instance->translation = vec3_sub(vec3_new(0, 0, radius * view->distance), rotated_center);
+        mark_instance_moved(0, 0);
+        init_camera(vec3_new(0, 0, 0), vec3_new(0, 0, 1));
+
+        for (int m = 0; m < NUM_GOLDEN_METHODS; m++)
+        {
+            set_render_method(golden_methods[m].method);
+            run->render_frame();
+
+            char reference_filename[1024];
+            char diff_filename[1024];
+            snprintf(reference_filename, sizeof(reference_filename), "%s/%s_%s_%s.png",
+                     run->reference_dir, asset->name, view->name, golden_methods[m].name);
+            snprintf(diff_filename, sizeof(diff_filename), "%s/%s_%s_%s.%s.png",
+                     run->reference_dir, asset->name, view->name, golden_methods[m].name, diff_suffix);
+
+            if (run->update_references)
+            {
+                if (write_png(reference_filename, get_color_buffer(), get_window_width(), get_window_height()))
+                    run->num_passed++;
+                else
+                    run->num_failed++;
+            }
+            else if (compare_with_reference(reference_filename, diff_filename, label, tolerance, max_mismatch_fraction))
+            {
+                remove(diff_filename);
+                run->num_passed++;
+            }
+            else
+            {
+                run->num_failed++;
+            }
+        }
+    }
+}
+
+// Index of another textured asset with its own texture, so the atlas has two to pack
+static int get_companion_asset(int asset_index)
+{
+    for (int i = 1; i < NUM_GOLDEN_ASSETS; i++)
+    {
+        const golden_asset_t *companion = &golden_assets[(asset_index + i) % NUM_GOLDEN_ASSETS];
+        if (companion->png_filename != NULL && strcmp(companion->png_filename, golden_assets[asset_index].png_filename) != 0)
+            return (asset_index + i) % NUM_GOLDEN_ASSETS;
+    }
+    return -1;
+}
+
+int run_golden_tests(const char *reference_dir, bool update_references, int tolerance, golden_render_frame_fn render_frame)
+{
+    if (update_references)
+    {
+        mkdir(reference_dir, 0755);
+    }
+
+    golden_run_t run = {reference_dir, update_references, render_frame, 0, 0};
+    for (int a = 0; a < NUM_GOLDEN_ASSETS; a++)
+    {
+        const golden_asset_t *asset = &golden_assets[a];
+        if (!load_golden_mesh(asset))
+        {
+            printf("FAIL %s: could not load mesh\n", asset->name);
+            run.num_failed++;
+            continue;
+        }
+
+        // Variants place the mesh by the bounds of the full precision vertices,
+        // quantized meshes keep no float vertices to measure
+        vec3_t center;
+        float radius;
+        get_mesh_bounding_sphere(get_mesh(0), &center, &radius);
+        render_golden_views(&run, asset, NULL, center, radius, tolerance, GOLDEN_MAX_MISMATCH_FRACTION);
+
+        // References are only ever written from the full precision pass
+        for (int i = 0; i < NUM_GOLDEN_VARIANTS && !update_references; i++)
+        {
+            const golden_variant_t *variant = &golden_variants[i];
+            bool texture_only = variant->compress_textures || variant->texture_atlas;
+            if (texture_only && asset->png_filename == NULL)
+                continue;
+
+            init_vertex_quantization(variant->quantize_vertices);
+            init_texture_compression(variant->compress_textures);
+            init_texture_atlas(variant->texture_atlas);
+            if (!load_golden_mesh(asset))
+            {
+                printf("FAIL %s (%s): could not load mesh\n", asset->name, variant->name);
+                run.num_failed++;
+                continue;
+            }
+
+            // A mesh without instances adds its texture to the atlas without being drawn
+            int companion = variant->texture_atlas ? get_companion_asset(a) : -1;
+            if (companion >= 0)
+                load_mesh(golden_assets[companion].obj_filename, golden_assets[companion].png_filename);
+
+            render_golden_views(&run, asset, variant, center, radius, variant->tolerance, variant->max_mismatch_fraction);
+
+            free_meshes();
+            free_texture_atlas();
+        }
+        init_vertex_quantization(false);
+        init_texture_compression(false);
+        init_texture_atlas(false);
+    }
+
+    free_meshes();
+
+    printf("golden: %d %s, %d failed\n", run.num_passed, update_references ? "references written" : "passed", run.num_failed);
+    return run.num_failed;
+}
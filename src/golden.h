@@ -0,0 +1,40 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Golden-image regression harness. Renders every asset in every
+// render method from fixed views and compares the frames against
+// reference PNG images, writing a diff image for each failure. The
+// assets are then rendered again with vertex quantization, BC1
+// texture compression and the texture atlas, and compared against the
+// same references within the limits of each of those paths.
+//
+// Frames of the same build match their references exactly; the
+// tolerance only absorbs rounding of shading and texel colors. Edge
+// pixels that another compiler covers differently differ by far more
+// and are bounded by the mismatch fraction instead.
+//
+// The variant limits were measured at 160x120 (19200 pixels):
+// quantized positions move a few vertices across a pixel boundary,
+// which redraws whole wire lines (at most 313 pixels, sphere front);
+// BC1 blocks shift texel colors by up to 91, with at most 162 pixels
+// over 32. The atlas samples the same texels and must match exactly.
+////////////////////////////////////////////////////////////////////
+#define GOLDEN_DEFAULT_TOLERANCE 2
+#define GOLDEN_MAX_MISMATCH_FRACTION 0.001 // Of the pixels, allowed over the tolerance
+
+#define GOLDEN_QUANTIZE_TOLERANCE 2
+#define GOLDEN_QUANTIZE_MISMATCH_FRACTION 0.02
+#define GOLDEN_COMPRESS_TOLERANCE 32
+#define GOLDEN_COMPRESS_MISMATCH_FRACTION 0.01
+#define GOLDEN_ATLAS_TOLERANCE 0
+#define GOLDEN_ATLAS_MISMATCH_FRACTION 0.0
+
+typedef void (*golden_render_frame_fn)(void);
+
+// Returns the number of failed cases (0 when everything matches)
+int run_golden_tests(const char *reference_dir, bool update_references, int tolerance, golden_render_frame_fn render_frame);
+
+#endif
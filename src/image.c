@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+#include "upng.h"
+
+////////////////////////////////////////////////////////////////////
+// Color buffer pixels are stored as RGBA32, i.e. bytes R,G,B,A in
+// memory order, so read them byte by byte to stay endian-agnostic.
+////////////////////////////////////////////////////////////////////
+static void pixel_to_rgb(const uint32_t *pixel, unsigned char rgb[3])
+{
+    const unsigned char *bytes = (const unsigned char *)pixel;
+    rgb[0] = bytes[0];
+    rgb[1] = bytes[1];
+    rgb[2] = bytes[2];
+}
+
+bool write_ppm(const char *filename, const uint32_t *pixels, int width, int height)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening %s for writing.\n", filename);
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int i = 0; i < width * height; i++)
+    {
+        unsigned char rgb[3];
+        pixel_to_rgb(&pixels[i], rgb);
+        fwrite(rgb, 1, 3, file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// Minimal PNG encoder: 8-bit RGB, each scanline filtered with the
+// filter giving the smallest sum of absolute bytes, and a zlib stream
+// made of one deflate block with the fixed Huffman codes. Matches are
+// found greedily through hash chains over the last 32K bytes. Frames
+// with flat backgrounds shrink to a few percent of their PPM size
+// without any external library.
+////////////////////////////////////////////////////////////////////
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_HASH_SIZE 4096
+#define DEFLATE_MAX_CHAIN 32
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+static uint32_t crc_table[256];
+static bool crc_table_ready = false;
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t length)
+{
+    if (!crc_table_ready)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[n] = c;
+        }
+        crc_table_ready = true;
+    }
+
+    for (size_t i = 0; i < length; i++)
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static void put_u32_be(unsigned char *out, uint32_t value)
+{
+    out[0] = (value >> 24) & 0xFF;
+    out[1] = (value >> 16) & 0xFF;
+    out[2] = (value >> 8) & 0xFF;
+    out[3] = value & 0xFF;
+}
+
+static void write_png_chunk(FILE *file, const char *type, const unsigned char *data, uint32_t length)
+{
+    unsigned char header[8];
+    put_u32_be(header, length);
+    memcpy(header + 4, type, 4);
+    fwrite(header, 1, 8, file);
+    if (length > 0)
+        fwrite(data, 1, length, file);
+
+    uint32_t crc = crc32_update(0xFFFFFFFFu, (const unsigned char *)type, 4);
+    crc = crc32_update(crc, data, length) ^ 0xFFFFFFFFu;
+    unsigned char footer[4];
+    put_u32_be(footer, crc);
+    fwrite(footer, 1, 4, file);
+}
+
+// Deflate output, bits packed from the least significant bit of each byte
+typedef struct
+{
+    unsigned char *data;
+    size_t pos;
+    uint32_t bits;
+    int num_bits;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *writer, uint32_t value, int count)
+{
+    writer->bits |= value << writer->num_bits;
+    writer->num_bits += count;
+    while (writer->num_bits >= 8)
+    {
+        writer->data[writer->pos++] = writer->bits & 0xFF;
+        writer->bits >>= 8;
+        writer->num_bits -= 8;
+    }
+}
+
+// Huffman codes are stored starting from their most significant bit
+static void put_code(bit_writer_t *writer, uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+    put_bits(writer, reversed, length);
+}
+
+static void put_fixed_symbol(bit_writer_t *writer, int symbol)
+{
+    if (symbol < 144)
+        put_code(writer, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        put_code(writer, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        put_code(writer, symbol - 256, 7);
+    else
+        put_code(writer, 0xC0 + symbol - 280, 8);
+}
+
+static void put_match(bit_writer_t *writer, int length, int distance)
+{
+    static const int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                          257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const int distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                           7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    int l = 28;
+    while (length_base[l] > length)
+        l--;
+    put_fixed_symbol(writer, 257 + l);
+    put_bits(writer, length - length_base[l], length_extra[l]);
+
+    int d = 29;
+    while (distance_base[d] > distance)
+        d--;
+    put_code(writer, d, 5);
+    put_bits(writer, distance - distance_base[d], distance_extra[d]);
+}
+
+static int hash3(const unsigned char *bytes)
+{
+    return ((bytes[0] << 8) ^ (bytes[1] << 4) ^ bytes[2]) & (DEFLATE_HASH_SIZE - 1);
+}
+
+// Compress into a single final block with the fixed codes; returns the size written
+static size_t deflate_fixed(const unsigned char *in, size_t size, unsigned char *out)
+{
+    bit_writer_t writer = {out, 0, 0, 0};
+    put_bits(&writer, 1, 1); // BFINAL
+    put_bits(&writer, 1, 2); // BTYPE = 01 (fixed Huffman codes)
+
+    int head[DEFLATE_HASH_SIZE];
+    int *previous = (int *)malloc(sizeof(int) * DEFLATE_WINDOW_SIZE);
+    for (int h = 0; h < DEFLATE_HASH_SIZE; h++)
+        head[h] = -1;
+
+    size_t i = 0;
+    while (i < size)
+    {
+        int best_length = 0, best_distance = 0;
+        if (previous != NULL && i + DEFLATE_MIN_MATCH <= size)
+        {
+            int h = hash3(&in[i]);
+            size_t max_length = size - i < DEFLATE_MAX_MATCH ? size - i : DEFLATE_MAX_MATCH;
+            int candidate = head[h];
+            for (int chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0 && i - candidate <= DEFLATE_WINDOW_SIZE - 1; chain++)
+            {
+                int length = 0;
+                while ((size_t)length < max_length && in[candidate + length] == in[i + length])
+                    length++;
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_distance = (int)(i - candidate);
+                }
+                candidate = previous[candidate % DEFLATE_WINDOW_SIZE];
+            }
+        }
+
+        int advance = best_length >= DEFLATE_MIN_MATCH ? best_length : 1;
+        if (advance > 1)
+            put_match(&writer, best_length, best_distance);
+        else
+            put_fixed_symbol(&writer, in[i]);
+
+        // Every position covered goes into the hash chains
+        for (int k = 0; k < advance; k++, i++)
+        {
+            if (previous != NULL && i + DEFLATE_MIN_MATCH <= size)
+            {
+                int h = hash3(&in[i]);
+                previous[i % DEFLATE_WINDOW_SIZE] = head[h];
+                head[h] = (int)i;
+            }
+        }
+    }
+    put_fixed_symbol(&writer, 256); // End of block
+    put_bits(&writer, 0, 7);        // Flush the last byte
+
+    free(previous);
+    return writer.pos;
+}
+
+static int paeth_predictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+// Filter a scanline of RGB bytes with the given PNG filter type
+static void filter_scanline(unsigned char *out, const unsigned char *line, const unsigned char *previous, size_t length, int type)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        int a = i >= 3 ? line[i - 3] : 0;
+        int b = previous != NULL ? previous[i] : 0;
+        int c = i >= 3 && previous != NULL ? previous[i - 3] : 0;
+        int predictor = type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : type == 4 ? paeth_predictor(a, b, c) : 0;
+        out[i] = (unsigned char)(line[i] - predictor);
+    }
+}
+
+bool write_png(const char *filename, const uint32_t *pixels, int width, int height)
+{
+    // Raw image data: one filter byte followed by the filtered RGB bytes of each scanline
+    size_t line_size = (size_t)width * 3;
+    size_t row_size = 1 + line_size;
+    size_t raw_size = row_size * height;
+
+    // Literals take at most 9 bits, so the compressed data is at most 9/8 of the input
+    size_t idat_size = 2 + raw_size + raw_size / 8 + 16 + 4;
+
+    unsigned char *lines = (unsigned char *)malloc(line_size * height);
+    unsigned char *raw = (unsigned char *)malloc(raw_size);
+    unsigned char *candidate = (unsigned char *)malloc(line_size);
+    unsigned char *idat = (unsigned char *)malloc(idat_size);
+    if (lines == NULL || raw == NULL || candidate == NULL || idat == NULL)
+    {
+        free(lines);
+        free(raw);
+        free(candidate);
+        free(idat);
+        return false;
+    }
+
+    for (int i = 0; i < width * height; i++)
+        pixel_to_rgb(&pixels[i], &lines[i * 3]);
+
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *line = &lines[y * line_size];
+        const unsigned char *previous = y > 0 ? &lines[(y - 1) * line_size] : NULL;
+        unsigned char *row = &raw[y * row_size];
+
+        // Keep the filter whose output bytes, read as signed, sum to the least
+        long best_sum = -1;
+        for (int type = 0; type <= 4; type++)
+        {
+            filter_scanline(candidate, line, previous, line_size, type);
+            long sum = 0;
+            for (size_t i = 0; i < line_size; i++)
+                sum += abs((signed char)candidate[i]);
+            if (best_sum < 0 || sum < best_sum)
+            {
+                best_sum = sum;
+                row[0] = (unsigned char)type;
+                memcpy(&row[1], candidate, line_size);
+            }
+        }
+    }
+
+    // zlib header (deflate, 32K window, no preset dictionary, fastest)
+    size_t pos = 0;
+    idat[pos++] = 0x78;
+    idat[pos++] = 0x01;
+    pos += deflate_fixed(raw, raw_size, &idat[pos]);
+
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+    for (size_t i = 0; i < raw_size; i++)
+    {
+        adler_a = (adler_a + raw[i]) % 65521;
+        adler_b = (adler_b + adler_a) % 65521;
+    }
+    put_u32_be(&idat[pos], (adler_b << 16) | adler_a);
+    pos += 4;
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening %s for writing.\n", filename);
+        free(lines);
+        free(raw);
+        free(candidate);
+        free(idat);
+        return false;
+    }
+
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    fwrite(signature, 1, 8, file);
+
+    unsigned char ihdr[13];
+    put_u32_be(&ihdr[0], width);
+    put_u32_be(&ihdr[4], height);
+    ihdr[8] = 8;   // bit depth
+    ihdr[9] = 2;   // color type RGB
+    ihdr[10] = 0;  // compression method
+    ihdr[11] = 0;  // filter method
+    ihdr[12] = 0;  // no interlacing
+    write_png_chunk(file, "IHDR", ihdr, 13);
+    write_png_chunk(file, "IDAT", idat, (uint32_t)pos);
+    write_png_chunk(file, "IEND", NULL, 0);
+
+    fclose(file);
+    free(lines);
+    free(raw);
+    free(candidate);
+    free(idat);
+    return true;
+}
+
+uint32_t *read_png(const char *filename, int *width, int *height)
+{
+    upng_t *image = upng_new_from_file(filename);
+    if (image == NULL)
+        return NULL;
+
+    // Only the 8-bit layouts written by this encoder and by common tools are read
+    uint32_t *pixels = NULL;
+    upng_format format = upng_decode(image) == UPNG_EOK ? upng_get_format(image) : UPNG_BADFORMAT;
+    if (format == UPNG_RGB8 || format == UPNG_RGBA8)
+    {
+        *width = upng_get_width(image);
+        *height = upng_get_height(image);
+        pixels = (uint32_t *)malloc(sizeof(uint32_t) * (*width) * (*height));
+    }
+
+    if (pixels != NULL)
+    {
+        int bytes_per_pixel = format == UPNG_RGB8 ? 3 : 4;
+        const unsigned char *source = upng_get_buffer(image);
+        for (int i = 0; i < (*width) * (*height); i++)
+        {
+            unsigned char rgba[4] = {0, 0, 0, 0xFF};
+            memcpy(rgba, &source[i * bytes_per_pixel], 3);
+            memcpy(&pixels[i], rgba, sizeof(uint32_t));
+        }
+    }
+
+    upng_free(image);
+    return pixels;
+}
+
+bool write_image(const char *filename, const uint32_t *pixels, int width, int height)
+{
+    const char *extension = strrchr(filename, '.');
+    if (extension != NULL && strcmp(extension, ".png") == 0)
+    {
+        return write_png(filename, pixels, width, height);
+    }
+    return write_ppm(filename, pixels, width, height);
+}
@@ -0,0 +1,21 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Write a color buffer (RGBA32 byte order) to disk as an image file.
+// The alpha channel is dropped, both formats store 8-bit RGB.
+////////////////////////////////////////////////////////////////////
+bool write_ppm(const char *filename, const uint32_t *pixels, int width, int height);
+bool write_png(const char *filename, const uint32_t *pixels, int width, int height);
+
+// Read an 8-bit RGB/RGBA PNG into a newly allocated RGBA32 buffer,
+// NULL on failure
+uint32_t *read_png(const char *filename, int *width, int *height);
+
+// Pick PPM or PNG based on the filename extension (defaults to PPM)
+bool write_image(const char *filename, const uint32_t *pixels, int width, int height);
+
+#endif
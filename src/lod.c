@@ -0,0 +1,529 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lod.h"
+#include "array.h"
+#include "clipping.h"
+#include "trace.h"
+
+////////////////////////////////////////////////////////////////////
+// Symmetric 4x4 matrix summing the squared distances to a set of
+// planes (a, b, c, d), stored as its upper triangle:
+// aa ab ac ad bb bc bd cc cd dd
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    double q[10];
+} quadric_t;
+
+typedef struct
+{
+    int v[3];       // Welded vertex of each corner
+    int vertex[3];  // Vertex of each corner, carrying its UV
+    uint32_t color;
+    bool removed;   // Collapsed into a degenerate face
+} lod_face_t;
+
+////////////////////////////////////////////////////////////////////
+// Moving vertex from onto vertex to. The stamps record the versions
+// of both quadrics when the cost was computed; a collapse whose
+// vertices changed since then is stale and skipped.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    double cost;
+    int from;
+    int to;
+    int from_stamp;
+    int to_stamp;
+} collapse_t;
+
+typedef struct
+{
+    collapse_t *items;
+    int size;
+    int capacity;
+} collapse_heap_t;
+
+// Corners are rebound from one vertex to another when a collapse moves them
+typedef struct
+{
+    int from;
+    int to;
+} uv_remap_t;
+
+static bool lod_enabled = true;
+static const vertex_t *weld_vertices = NULL;
+
+void init_lod(bool enabled)
+{
+    lod_enabled = enabled;
+}
+
+void toggle_lod_selection(void)
+{
+    lod_enabled = !lod_enabled;
+}
+
+static void quadric_add_plane(quadric_t *quadric, double a, double b, double c, double d, double weight)
+{
+    double *q = quadric->q;
+    q[0] += weight * a * a;
+    q[1] += weight * a * b;
+    q[2] += weight * a * c;
+    q[3] += weight * a * d;
+    q[4] += weight * b * b;
+    q[5] += weight * b * c;
+    q[6] += weight * b * d;
+    q[7] += weight * c * c;
+    q[8] += weight * c * d;
+    q[9] += weight * d * d;
+}
+
+static void quadric_add(quadric_t *quadric, const quadric_t *other)
+{
+    for (int i = 0; i < 10; i++)
+        quadric->q[i] += other->q[i];
+}
+
+static double quadric_error(const quadric_t *a, const quadric_t *b, vec3_t p)
+{
+    double q[10];
+    for (int i = 0; i < 10; i++)
+        q[i] = a->q[i] + b->q[i];
+    double x = p.x, y = p.y, z = p.z;
+    double error = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+                   q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+                   q[7] * z * z + 2 * q[8] * z +
+                   q[9];
+    return error > 0 ? error : 0;
+}
+
+static void heap_push(collapse_heap_t *heap, collapse_t collapse)
+{
+    if (heap->size == heap->capacity)
+    {
+        heap->capacity = heap->capacity > 0 ? heap->capacity * 2 : 1024;
+        heap->items = (collapse_t *)realloc(heap->items, sizeof(collapse_t) * heap->capacity);
+    }
+
+    int i = heap->size++;
+    while (i > 0 && heap->items[(i - 1) / 2].cost > collapse.cost)
+    {
+        heap->items[i] = heap->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->items[i] = collapse;
+}
+
+static collapse_t heap_pop(collapse_heap_t *heap)
+{
+    collapse_t top = heap->items[0];
+    collapse_t last = heap->items[--heap->size];
+
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= heap->size)
+            break;
+        if (child + 1 < heap->size && heap->items[child + 1].cost < heap->items[child].cost)
+            child++;
+        if (heap->items[child].cost >= last.cost)
+            break;
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->size > 0)
+        heap->items[i] = last;
+    return top;
+}
+
+static int compare_weld_positions(const void *a, const void *b)
+{
+    vec3_t p = weld_vertices[*(const int *)a].position;
+    vec3_t q = weld_vertices[*(const int *)b].position;
+    if (p.x != q.x)
+        return p.x < q.x ? -1 : 1;
+    if (p.y != q.y)
+        return p.y < q.y ? -1 : 1;
+    if (p.z != q.z)
+        return p.z < q.z ? -1 : 1;
+    return *(const int *)a - *(const int *)b;
+}
+
+////////////////////////////////////////////////////////////////////
+// Vertices are split along UV seams. Simplification works on
+// positions, so every vertex is mapped to the first one sharing its
+// position; the face corners keep their own vertex for the UV.
+////////////////////////////////////////////////////////////////////
+static int *weld_positions(const vertex_t *vertices, int num_vertices)
+{
+    int *order = (int *)malloc(sizeof(int) * num_vertices);
+    int *welded = (int *)malloc(sizeof(int) * num_vertices);
+    for (int i = 0; i < num_vertices; i++)
+        order[i] = i;
+
+    weld_vertices = vertices;
+    qsort(order, num_vertices, sizeof(int), compare_weld_positions);
+    weld_vertices = NULL;
+
+    for (int i = 0; i < num_vertices; i++)
+    {
+        bool same = i > 0 &&
+                    vertices[order[i - 1]].position.x == vertices[order[i]].position.x &&
+                    vertices[order[i - 1]].position.y == vertices[order[i]].position.y &&
+                    vertices[order[i - 1]].position.z == vertices[order[i]].position.z;
+        welded[order[i]] = same ? welded[order[i - 1]] : order[i];
+    }
+    free(order);
+    return welded;
+}
+
+static bool face_has_vertex(const lod_face_t *face, int v)
+{
+    return face->v[0] == v || face->v[1] == v || face->v[2] == v;
+}
+
+static int face_corner(const lod_face_t *face, int v)
+{
+    return face->v[0] == v ? 0 : (face->v[1] == v ? 1 : 2);
+}
+
+static vec3_t face_normal(const vertex_t *vertices, const lod_face_t *face, int moved_corner, vec3_t moved_position)
+{
+    vec3_t p[3];
+    for (int i = 0; i < 3; i++)
+        p[i] = (i == moved_corner) ? moved_position : vertices[face->v[i]].position;
+    return vec3_cross(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+}
+
+static bool tex2_equal(tex2_t a, tex2_t b)
+{
+    return a.u == b.u && a.v == b.v;
+}
+
+static void push_vertex_collapses(collapse_heap_t *heap, int v, int **vertex_faces, const lod_face_t *faces,
+                                  const quadric_t *quadrics, const int *stamps, const vertex_t *vertices)
+{
+    for (int i = 0; i < array_length(vertex_faces[v]); i++)
+    {
+        const lod_face_t *face = &faces[vertex_faces[v][i]];
+        if (face->removed)
+            continue;
+
+        for (int j = 0; j < 3; j++)
+        {
+            int other = face->v[j];
+            if (other == v)
+                continue;
+
+            collapse_t from_v = {quadric_error(&quadrics[v], &quadrics[other], vertices[other].position), v, other, stamps[v], stamps[other]};
+            collapse_t to_v = {quadric_error(&quadrics[v], &quadrics[other], vertices[v].position), other, v, stamps[other], stamps[v]};
+            heap_push(heap, from_v);
+            heap_push(heap, to_v);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// A collapse is refused when a face would flip or when a surviving
+// face around the moved vertex has a UV that no removed face maps to
+// a UV of the target: that vertex sits on a seam the edge does not
+// follow, and moving it would tear the texture. Returns the number of
+// faces removed, or -1 when the collapse is refused.
+////////////////////////////////////////////////////////////////////
+static int try_collapse(int from, int to, int **vertex_faces, lod_face_t *faces, const vertex_t *vertices,
+                        uv_remap_t **remaps)
+{
+    array_clear(*remaps);
+    for (int i = 0; i < array_length(vertex_faces[from]); i++)
+    {
+        const lod_face_t *face = &faces[vertex_faces[from][i]];
+        if (face->removed || !face_has_vertex(face, to))
+            continue;
+        uv_remap_t remap = {face->vertex[face_corner(face, from)], face->vertex[face_corner(face, to)]};
+        array_push(*remaps, remap);
+    }
+
+    for (int i = 0; i < array_length(vertex_faces[from]); i++)
+    {
+        const lod_face_t *face = &faces[vertex_faces[from][i]];
+        if (face->removed || face_has_vertex(face, to))
+            continue;
+
+        int corner = face_corner(face, from);
+        bool mapped = false;
+        for (int r = 0; r < array_length(*remaps) && !mapped; r++)
+            mapped = tex2_equal(vertices[(*remaps)[r].from].uv, vertices[face->vertex[corner]].uv);
+        if (!mapped)
+            return -1;
+
+        vec3_t old_normal = face_normal(vertices, face, -1, vertices[from].position);
+        vec3_t new_normal = face_normal(vertices, face, corner, vertices[to].position);
+        float alignment = vec3_dot(old_normal, new_normal);
+        if (alignment <= 0.25f * vec3_length(old_normal) * vec3_length(new_normal))
+            return -1;
+    }
+
+    // The collapse is valid, rebind the faces of from to the target
+    int num_removed = 0;
+    for (int i = 0; i < array_length(vertex_faces[from]); i++)
+    {
+        int face_index = vertex_faces[from][i];
+        lod_face_t *face = &faces[face_index];
+        if (face->removed)
+            continue;
+        if (face_has_vertex(face, to))
+        {
+            face->removed = true;
+            num_removed++;
+            continue;
+        }
+
+        int corner = face_corner(face, from);
+        for (int r = 0; r < array_length(*remaps); r++)
+        {
+            if (tex2_equal(vertices[(*remaps)[r].from].uv, vertices[face->vertex[corner]].uv))
+            {
+                face->vertex[corner] = (*remaps)[r].to;
+                break;
+            }
+        }
+        face->v[corner] = to;
+        array_push(vertex_faces[to], face_index);
+    }
+    return num_removed;
+}
+
+////////////////////////////////////////////////////////////////////
+// Every removed vertex ends up merged into a surviving one; its error
+// is the distance to the nearest plane of the faces now around that
+// vertex. The level error is the largest one, in model units.
+////////////////////////////////////////////////////////////////////
+static float measure_lod_error(const vertex_t *vertices, int num_vertices, const int *welded, const int *collapsed_into,
+                               int **vertex_faces, const lod_face_t *faces)
+{
+    float max_error = 0;
+    for (int v = 0; v < num_vertices; v++)
+    {
+        if (welded[v] != v || collapsed_into[v] < 0)
+            continue;
+
+        int survivor = collapsed_into[v];
+        while (collapsed_into[survivor] >= 0)
+            survivor = collapsed_into[survivor];
+
+        float error = -1;
+        for (int i = 0; i < array_length(vertex_faces[survivor]); i++)
+        {
+            const lod_face_t *face = &faces[vertex_faces[survivor][i]];
+            if (face->removed || !face_has_vertex(face, survivor))
+                continue;
+
+            vec3_t normal = face_normal(vertices, face, -1, vertices[face->v[0]].position);
+            if (vec3_length(normal) == 0)
+                continue;
+            vec3_normalize(&normal);
+            float distance = fabsf(vec3_dot(normal, vec3_sub(vertices[v].position, vertices[survivor].position)));
+            error = (error < 0) ? distance : fminf(error, distance);
+        }
+
+        // A vertex left without faces lies on geometry that collapsed entirely
+        if (error < 0)
+            error = vec3_length(vec3_sub(vertices[v].position, vertices[survivor].position));
+        max_error = fmaxf(max_error, error);
+    }
+    return max_error;
+}
+
+static void add_lod_level(mesh_t *mesh, const lod_face_t *faces, int num_faces, float error)
+{
+    mesh_lod_t *lod = &mesh->lods[mesh->num_lods++];
+    lod->faces = NULL;
+    lod->error = error;
+    for (int i = 0; i < num_faces; i++)
+    {
+        if (faces[i].removed)
+            continue;
+        face_t face = {
+            .a = faces[i].vertex[0],
+            .b = faces[i].vertex[1],
+            .c = faces[i].vertex[2],
+            .color = faces[i].color};
+        array_push(lod->faces, face);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Greedy half-edge collapses in order of quadric error (Garland and
+// Heckbert). A collapse keeps the position of its target vertex, so
+// every level indexes the vertex array of the full detail mesh. Open
+// edges get a steep plane through them so boundaries stay in place.
+// The error of a level is measured on the vertices it removed.
+////////////////////////////////////////////////////////////////////
+void generate_mesh_lods(mesh_t *mesh)
+{
+    const face_t *source_faces = mesh->lods[0].faces;
+    const vertex_t *vertices = mesh->vertices;
+    int num_faces = array_length(mesh->lods[0].faces);
+    int num_vertices = array_length(mesh->vertices);
+    mesh->num_lods = 1;
+    mesh->lods[0].error = 0;
+    if (num_faces * LOD_REDUCTION < LOD_MIN_FACES)
+        return;
+
+    TRACE_BEGIN("generate_lods");
+    int *welded = weld_positions(vertices, num_vertices);
+    lod_face_t *faces = (lod_face_t *)malloc(sizeof(lod_face_t) * num_faces);
+    int **vertex_faces = (int **)calloc(num_vertices, sizeof(int *));
+    quadric_t *quadrics = (quadric_t *)calloc(num_vertices, sizeof(quadric_t));
+    int *stamps = (int *)calloc(num_vertices, sizeof(int));
+
+    int num_alive = 0;
+    for (int i = 0; i < num_faces; i++)
+    {
+        const face_t *source = &source_faces[i];
+        lod_face_t face = {
+            .v = {welded[source->a], welded[source->b], welded[source->c]},
+            .vertex = {source->a, source->b, source->c},
+            .color = source->color};
+        face.removed = face.v[0] == face.v[1] || face.v[1] == face.v[2] || face.v[0] == face.v[2];
+        faces[i] = face;
+        if (face.removed)
+            continue;
+
+        num_alive++;
+        for (int j = 0; j < 3; j++)
+            array_push(vertex_faces[face.v[j]], i);
+
+        vec3_t normal = face_normal(vertices, &face, -1, vertices[face.v[0]].position);
+        if (vec3_length(normal) == 0)
+            continue;
+        vec3_normalize(&normal);
+        double d = -vec3_dot(normal, vertices[face.v[0]].position);
+        for (int j = 0; j < 3; j++)
+            quadric_add_plane(&quadrics[face.v[j]], normal.x, normal.y, normal.z, d, 1.0);
+    }
+
+    // Boundary edges belong to a single face
+    for (int i = 0; i < num_faces; i++)
+    {
+        const lod_face_t *face = &faces[i];
+        if (face->removed)
+            continue;
+
+        vec3_t normal = face_normal(vertices, face, -1, vertices[face->v[0]].position);
+        for (int j = 0; j < 3; j++)
+        {
+            int p = face->v[j];
+            int q = face->v[(j + 1) % 3];
+            int num_sharing = 0;
+            for (int k = 0; k < array_length(vertex_faces[p]); k++)
+                num_sharing += face_has_vertex(&faces[vertex_faces[p][k]], q);
+            if (num_sharing != 1)
+                continue;
+
+            vec3_t edge_normal = vec3_cross(vec3_sub(vertices[q].position, vertices[p].position), normal);
+            if (vec3_length(edge_normal) == 0)
+                continue;
+            vec3_normalize(&edge_normal);
+            double d = -vec3_dot(edge_normal, vertices[p].position);
+            quadric_add_plane(&quadrics[p], edge_normal.x, edge_normal.y, edge_normal.z, d, 10.0);
+            quadric_add_plane(&quadrics[q], edge_normal.x, edge_normal.y, edge_normal.z, d, 10.0);
+        }
+    }
+
+    collapse_heap_t heap = {NULL, 0, 0};
+    for (int v = 0; v < num_vertices; v++)
+    {
+        if (welded[v] == v)
+            push_vertex_collapses(&heap, v, vertex_faces, faces, quadrics, stamps, vertices);
+    }
+
+    // Each level aims at LOD_REDUCTION times the faces of the previous one
+    uv_remap_t *remaps = NULL;
+    int *collapsed_into = (int *)malloc(sizeof(int) * num_vertices);
+    for (int v = 0; v < num_vertices; v++)
+        collapsed_into[v] = -1;
+    int target = (int)(num_faces * LOD_REDUCTION);
+    while (mesh->num_lods < MAX_MESH_LODS && target >= LOD_MIN_FACES)
+    {
+        while (num_alive > target && heap.size > 0)
+        {
+            collapse_t collapse = heap_pop(&heap);
+            if (collapsed_into[collapse.from] >= 0 || collapsed_into[collapse.to] >= 0 ||
+                stamps[collapse.from] != collapse.from_stamp || stamps[collapse.to] != collapse.to_stamp)
+                continue;
+            int num_removed = try_collapse(collapse.from, collapse.to, vertex_faces, faces, vertices, &remaps);
+            if (num_removed < 0)
+                continue;
+
+            collapsed_into[collapse.from] = collapse.to;
+            quadric_add(&quadrics[collapse.to], &quadrics[collapse.from]);
+            stamps[collapse.to]++;
+            num_alive -= num_removed;
+            push_vertex_collapses(&heap, collapse.to, vertex_faces, faces, quadrics, stamps, vertices);
+        }
+
+        // A level that barely saves faces is not worth switching to
+        int previous = array_length(mesh->lods[mesh->num_lods - 1].faces);
+        if (num_alive > previous * 0.8)
+            break;
+        add_lod_level(mesh, faces, num_faces, measure_lod_error(vertices, num_vertices, welded, collapsed_into, vertex_faces, faces));
+        target = (int)(num_alive * LOD_REDUCTION);
+    }
+
+    free(collapsed_into);
+    array_free(remaps);
+    free(heap.items);
+    for (int v = 0; v < num_vertices; v++)
+        array_free(vertex_faces[v]);
+    free(vertex_faces);
+    free(quadrics);
+    free(stamps);
+    free(faces);
+    free(welded);
+    TRACE_END("generate_lods");
+}
+
+void select_instance_lod(const mesh_t *mesh, mesh_instance_t *instance, mat4_t model_view_matrix, float pixels_per_unit)
+{
+    if (!lod_enabled || mesh->num_lods <= 1)
+    {
+        instance->lod = 0;
+        return;
+    }
+
+    // Bounding sphere of the mesh in camera space; the view matrix keeps lengths
+    vec3_t center = vec3_mul(vec3_add(mesh->bounds.min, mesh->bounds.max), 0.5);
+    float radius = vec3_length(vec3_sub(mesh->bounds.max, center));
+    float scale = mat4_max_scale_3x3(model_view_matrix);
+    float distance = mat4_mul_vec4(model_view_matrix, vec4_from_vec3(center)).z - radius * scale;
+
+    // Full detail as soon as the sphere reaches the near plane
+    float z_near = frustum_planes[NEAR_FRUSTUM_PLANE].point.z;
+    if (distance <= z_near || radius <= 0)
+    {
+        instance->lod = 0;
+        return;
+    }
+
+    // Screen size of the error of a level, as a fraction of the projected sphere radius
+    float projected_radius = radius * scale * pixels_per_unit / distance;
+    int lod = 0;
+    for (int i = mesh->num_lods - 1; i > 0; i--)
+    {
+        if (mesh->lods[i].error / radius * projected_radius <= LOD_MAX_PIXEL_ERROR)
+        {
+            lod = i;
+            break;
+        }
+    }
+
+    // Finer levels are taken at once, coarser ones only well within the budget
+    while (lod > instance->lod &&
+           mesh->lods[lod].error / radius * projected_radius > LOD_MAX_PIXEL_ERROR * (1 - LOD_HYSTERESIS))
+        lod--;
+    instance->lod = lod;
+}
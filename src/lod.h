@@ -0,0 +1,31 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "mesh.h"
+
+////////////////////////////////////////////////////////////////////
+// Levels of detail. At load time every mesh is simplified with
+// quadric error metrics into coarser face lists sharing the vertices
+// of the full detail mesh. Each frame an instance draws the coarsest
+// level whose error covers less than LOD_MAX_PIXEL_ERROR pixels at
+// the nearest point of its bounding sphere.
+////////////////////////////////////////////////////////////////////
+#define LOD_REDUCTION 0.35       // Face count of a level relative to the previous one
+#define LOD_MIN_FACES 32         // No level is generated below this many faces
+#define LOD_MAX_PIXEL_ERROR 1.0  // Largest screen space error of the drawn level
+#define LOD_HYSTERESIS 0.25      // Fraction of the error budget a coarser level must stay under
+
+void init_lod(bool enabled);
+
+void toggle_lod_selection(void);
+
+// Fill lods[1..] of a mesh whose full detail faces are in lods[0]
+void generate_mesh_lods(mesh_t *mesh);
+
+// Update the level drawn by an instance; pixels_per_unit is the screen
+// size of one unit at distance one from the camera
+void select_instance_lod(const mesh_t *mesh, mesh_instance_t *instance, mat4_t model_view_matrix, float pixels_per_unit);
+
+#endif
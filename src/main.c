@@ -13,12 +13,30 @@
 #include "triangle.h"
 #include "camera.h"
 #include "clipping.h"
+#include "options.h"
+#include "timer.h"
+#include "stats.h"
+#include "bench.h"
+#include "profiler.h"
+#include "trace.h"
+#include "golden.h"
+#include "scene.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "lod.h"
+#include "meshcache.h"
+#include "texcache.h"
+#include "vertexcache.h"
+#include "quantize.h"
+#include "asset.h"
+#include "stream.h"
+#include "atlas.h"
 
 ////////////////////////////////////////////////////////////////////
-// Array of triangles to be rendered frame by frame
+// Dynamic array of triangles to be rendered frame by frame, it keeps
+// its capacity between frames so it only grows while the scene does
 ////////////////////////////////////////////////////////////////////
-#define MAX_TRIANGLES_PER_MESH 10000
-triangle_t triangles_to_render[MAX_TRIANGLES_PER_MESH];
+raster_triangle_t *triangles_to_render = NULL;
 int num_triangles_to_render = 0;
 
 ////////////////////////////////////////////////////////////////////
@@ -26,6 +44,7 @@ int num_triangles_to_render = 0;
 ////////////////////////////////////////////////////////////////////
 bool is_running = false;
 int previous_frame_time = 0;
+int frame_count = 0;
 float delta_time = 0;
 
 ////////////////////////////////////////////////////////////////////
@@ -35,6 +54,18 @@ mat4_t world_matrix;
 mat4_t view_matrix;
 mat4_t proj_matrix;
 
+////////////////////////////////////////////////////////////////////
+// Render methods in the order of the number keys 1 to 7
+////////////////////////////////////////////////////////////////////
+static const int render_method_keys[] = {
+    RENDER_WIRE_VERTEX,
+    RENDER_WIRE,
+    RENDER_FILL_TRIANGLE,
+    RENDER_FILL_TRIANGLE_WIRE,
+    RENDER_TEXTURED,
+    RENDER_TEXTURED_WIRE,
+    RENDER_OVERDRAW};
+
 ////////////////////////////////////////////////////////////////////
 // Setup function to initialize variables and game obejcts
 ////////////////////////////////////////////////////////////////////
@@ -59,12 +90,32 @@ void setup(void)
     // Initialize frustum planes with point and normal
     init_frustum_planes(fov_x, fov_y, z_near, z_far);
 
-    // TODO: Load a mesh by passing the filepath of the obj file and the filepath of the texture
-    // While also passing initial mesh scale, translation and rotation.
-    load_mesh("./assets/runway.obj", "./assets/runway.png", vec3_new(1, 1, 1), vec3_new(0, -1.5, 23), vec3_new(0, 0, 0));
-    load_mesh("./assets/f22.obj", "./assets/f22.png", vec3_new(1, 1, 1), vec3_new(0, -1.3, 5), vec3_new(0, -M_PI / 2, 0));
-    load_mesh("./assets/efa.obj", "./assets/efa.png", vec3_new(1, 1, 1), vec3_new(-2, -1.3, 9), vec3_new(0, -M_PI / 2, 0));
-    load_mesh("./assets/f117.obj", "./assets/f117.png", vec3_new(1, 1, 1), vec3_new(2, -1.3, 9), vec3_new(0, -M_PI / 2, 0));
+    // The benchmark always renders its own fixed scene fully textured
+    const char *scene_filename = get_options()->scene_file;
+    if (get_options()->bench)
+    {
+        set_render_method(RENDER_TEXTURED);
+        init_benchmark(get_options()->max_frames);
+        if (scene_filename == NULL)
+            scene_filename = BENCHMARK_SCENE_FILE;
+    }
+    else if (scene_filename == NULL)
+    {
+        scene_filename = DEFAULT_SCENE_FILE;
+    }
+
+    // The golden-image harness loads its own meshes one at a time
+    if (get_options()->golden_dir == NULL && !load_scene(scene_filename))
+    {
+        is_running = false;
+    }
+    start_streaming();
+
+    // A render method chosen on the command line overrides the defaults
+    if (get_options()->render_method > 0)
+    {
+        set_render_method(render_method_keys[get_options()->render_method - 1]);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -116,6 +167,31 @@ void process_input(void)
                 set_render_method(RENDER_TEXTURED_WIRE);
                 break;
             }
+            if (event.key.keysym.sym == SDLK_7)
+            {
+                set_render_method(RENDER_OVERDRAW);
+                break;
+            }
+            if (event.key.keysym.sym == SDLK_t)
+            {
+                start_trace_capture(get_options()->trace_frames);
+                break;
+            }
+            if (event.key.keysym.sym == SDLK_p)
+            {
+                toggle_profiler_hud();
+                break;
+            }
+            if (event.key.keysym.sym == SDLK_o)
+            {
+                toggle_occlusion_culling();
+                break;
+            }
+            if (event.key.keysym.sym == SDLK_l)
+            {
+                toggle_lod_selection();
+                break;
+            }
             if (event.key.keysym.sym == SDLK_c)
             {
                 set_cull_method(CULL_BACKFACE);
@@ -188,151 +264,174 @@ void process_input(void)
 //                        `--> | Screen space |  <-- ready to render
 //                             +--------------+
 ///////////////////////////////////////////////////////////////////////////////
-void process_graphic_pipeline_stages(mesh_t *mesh)
+void process_graphic_pipeline_stages(mesh_t *mesh, mesh_instance_t *instance, int mesh_index)
 {
-    // Create a scale matrix to multiply the mesh vertices
-    mat4_t scale_matrix = mat4_make_scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-    mat4_t translation_matrix = mat4_make_translation(mesh->translation.x, mesh->translation.y, mesh->translation.z);
-    mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh->rotation.x);
-    mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh->rotation.y);
-    mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh->rotation.z);
-
-    // Update camera look at target to create view matrix
-    vec3_t target = get_camera_lookat_target();
-    vec3_t up_direction = vec3_new(0, 1, 0);
-    mat4_t view_matrix = mat4_look_at(get_camera_position(), target, up_direction);
-
-    // Loop all triangle faces of mesh.
-    int num_faces = array_length(mesh->faces);
-    for (int i = 0; i < num_faces; i++)
+    uint64_t geometry_start = profile_begin();
+    TRACE_BEGIN_ID("geometry", mesh_index);
+
+    // Create a World Matrix combining scale, rotation and translation matrices
+    world_matrix = get_mesh_instance_world_matrix(instance);
+
+    // Pick the level of detail from the screen size of the instance
+    float pixels_per_unit = proj_matrix.m[1][1] * get_window_height() / 2.0;
+    mat4_t model_view_matrix = mat4_mul_mat4(view_matrix, world_matrix);
+    select_instance_lod(mesh, instance, model_view_matrix, pixels_per_unit);
+    const mesh_lod_t *lod = &mesh->lods[instance->lod];
+
+    ////////////////////////////////////////////////////////////////////
+    // Back faces are rejected in model space: the camera goes through
+    // the inverse model view matrix once, then each face needs a single
+    // dot product with its precomputed plane. A mirroring transform
+    // flips the winding, so the side test flips with it. Normals of the
+    // surviving faces reach camera space through the inverse transpose.
+    ////////////////////////////////////////////////////////////////////
+    mat4_t inverse_model_view = mat4_inverse_affine(model_view_matrix);
+    vec3_t model_camera = vec3_new(inverse_model_view.m[0][3], inverse_model_view.m[1][3], inverse_model_view.m[2][3]);
+    float orientation = mat4_determinant_3x3(model_view_matrix) < 0 ? -1 : 1;
+
+    // Quantized positions are dequantized by the same transform that takes them to camera space
+    mat4_t vertex_matrix = model_view_matrix;
+    if (mesh->quantized_vertices != NULL)
+        vertex_matrix = mat4_mul_mat4(model_view_matrix, mesh->dequantize_matrix);
+
+    // Reject whole clusters against the frustum and by their normal cone first
+    float scale = mat4_max_scale_3x3(model_view_matrix);
+    for (int m = 0; m < array_length(lod->meshlets); m++)
     {
-        face_t mesh_face = mesh->faces[i];
-
-        vec3_t face_vertices[3];
-        face_vertices[0] = mesh->vertices[mesh_face.a];
-        face_vertices[1] = mesh->vertices[mesh_face.b];
-        face_vertices[2] = mesh->vertices[mesh_face.c];
-
-        vec4_t transformed_vertices[3];
-
-        // Loop 3 vertices of current faces and apply transformations
-        for (int j = 0; j < 3; j++)
+        const meshlet_t *meshlet = &lod->meshlets[m];
+        frame_stats.meshlets_submitted++;
+        if (is_meshlet_outside_frustum(meshlet, model_view_matrix, scale))
         {
-            vec4_t transformed_vertex = vec4_from_vec3(face_vertices[j]);
-
-            // Create a World Matrix combining scale, rotation and translation matrices
-            world_matrix = mat4_identity();
-            // Order matters. Scale -> Rotation -> Translation. [T]*[R]*[S]*v
-            world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
-            world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
-
-            // Multiply the world matrix by the original vector
-            transformed_vertex = mat4_mul_vec4(world_matrix, transformed_vertex);
-
-            // Multiply the view matrix by the original vector to transform the scene to camera space
-            transformed_vertex = mat4_mul_vec4(view_matrix, transformed_vertex);
-
-            // Save the transformed vertex unto the array of transformed vertices
-            transformed_vertices[j] = transformed_vertex;
+            frame_stats.meshlets_frustum_culled++;
+            continue;
         }
-
-        // Calculate the triangle face normal
-        vec3_t face_normal = get_triangle_normal(transformed_vertices);
-
-        // Apply backface culling
-        if (is_cull_backface())
+        if (is_cull_backface() && is_meshlet_backfacing(meshlet, model_camera, orientation))
         {
-            // Get Camera to A position.
-            vec3_t camera_ray = vec3_sub(vec3_new(0, 0, 0), vec3_from_vec4(transformed_vertices[0]));
-
-            // Get dot product of camera ray and face normal
-            float dot_normal_camera = vec3_dot(face_normal, camera_ray);
-
-            // Bypass triangles that look away from camera.
-            if (dot_normal_camera < 0)
-                continue;
+            frame_stats.meshlets_backface_culled++;
+            continue;
         }
 
-        // Create a polygon from the original triangle to be clipped
-        polygon_t polygon = create_polygon_from_triangle(
-            vec3_from_vec4(transformed_vertices[0]),
-            vec3_from_vec4(transformed_vertices[1]),
-            vec3_from_vec4(transformed_vertices[2]),
-            mesh_face.a_uv,
-            mesh_face.b_uv,
-            mesh_face.c_uv);
-
-        // Clip the polygon from the original transformed triangle to be clipped
-        clip_polygon(&polygon);
-
-        // Break the polygon apart back into individual triangles
-        triangle_t triangles_after_clipping[MAX_NUM_POLY_TRIANGLES];
-        int num_triangles_after_clipping = 0;
-
-        triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
-
-        // Loop the assembled triangles after clipping
-        for (int t = 0; t < num_triangles_after_clipping; t++)
+        // Loop all triangle faces of the cluster.
+        for (int i = meshlet->first_face; i < meshlet->first_face + meshlet->num_faces; i++)
         {
-            triangle_t triangle_after_clipping = triangles_after_clipping[t];
+            face_t mesh_face = lod->faces[i];
+            vec4_t plane = lod->face_planes[i];
+            frame_stats.faces_submitted++;
+
+            // Bypass triangles that look away from camera.
+            if (is_cull_backface())
+            {
+                float camera_side = plane.x * model_camera.x + plane.y * model_camera.y + plane.z * model_camera.z + plane.w;
+                if (camera_side * orientation < 0)
+                {
+                    frame_stats.faces_backface_culled++;
+                    continue;
+                }
+            }
 
-            vec4_t projected_points[3];
+            int corners[3] = {mesh_face.a, mesh_face.b, mesh_face.c};
+            vec4_t transformed_vertices[3];
+            tex2_t face_uvs[3];
 
-            // Look all 3 vertices to perform projection
+            // Loop 3 vertices of current faces and transform them to camera space
             for (int j = 0; j < 3; j++)
             {
-                // Project the current vertex
-                projected_points[j] = mat4_mul_vec4_project(proj_matrix, triangle_after_clipping.points[j]);
-
-                // Perform perspective divide
-                // if (projected_points[j].w != 0)
-                // {
-                //     projected_points[j].x /= projected_points[j].w;
-                //     projected_points[j].y /= projected_points[j].w;
-                //     projected_points[j].z /= projected_points[j].w;
-                // }
-
-                // Invert y values to account for flipped screen y coordinates.
-                projected_points[j].y *= -1;
-
-                // Scale projected points to half window size
-                projected_points[j].x *= (get_window_width() / 2.0);
-                projected_points[j].y *= (get_window_height() / 2.0);
-
-                // Translate projected point to middle of screen
-                projected_points[j].x += (get_window_width() / 2.0);
-                projected_points[j].y += (get_window_height() / 2.0);
+                vec3_t position;
+                if (mesh->quantized_vertices != NULL)
+                {
+                    const quantized_vertex_t *vertex = &mesh->quantized_vertices[corners[j]];
+                    position = vec3_new(vertex->position[0], vertex->position[1], vertex->position[2]);
+                    face_uvs[j].u = mesh->uv_offset.u + vertex->uv[0] * mesh->uv_step.u;
+                    face_uvs[j].v = mesh->uv_offset.v + vertex->uv[1] * mesh->uv_step.v;
+                }
+                else
+                {
+                    position = mesh->vertices[corners[j]].position;
+                    face_uvs[j] = mesh->vertices[corners[j]].uv;
+                }
+                transformed_vertices[j] = mat4_mul_vec4(vertex_matrix, vec4_from_vec3(position));
             }
 
-            // Calculate shade intensity based on alignment of the triangle normal and the inverse of the light direction
-            float light_intensity_factor = -vec3_dot(face_normal, get_light_direction());
-
-            // Calculate triangle color based on light angle
-            uint32_t triangle_color = light_apply_intensity(mesh_face.color, light_intensity_factor);
-
-            triangle_t triangle_to_render = {
-                .points = {
-                    {projected_points[0].x, projected_points[0].y, projected_points[0].z, projected_points[0].w},
-                    {projected_points[1].x, projected_points[1].y, projected_points[1].z, projected_points[1].w},
-                    {projected_points[2].x, projected_points[2].y, projected_points[2].z, projected_points[2].w}},
-                .texcoords = {
-                    {triangle_after_clipping.texcoords[0].u, triangle_after_clipping.texcoords[0].v},
-                    {triangle_after_clipping.texcoords[1].u, triangle_after_clipping.texcoords[1].v},
-                    {triangle_after_clipping.texcoords[2].u, triangle_after_clipping.texcoords[2].v},
-                },
-                .color = triangle_color,
-                .texture = mesh->texture};
-
-            // Save the projected triangle in array of screen space triangles
-            if (num_triangles_to_render < MAX_TRIANGLES_PER_MESH)
+            // Camera space face normal, used for shading
+            vec3_t face_normal = vec3_new(
+                inverse_model_view.m[0][0] * plane.x + inverse_model_view.m[1][0] * plane.y + inverse_model_view.m[2][0] * plane.z,
+                inverse_model_view.m[0][1] * plane.x + inverse_model_view.m[1][1] * plane.y + inverse_model_view.m[2][1] * plane.z,
+                inverse_model_view.m[0][2] * plane.x + inverse_model_view.m[1][2] * plane.y + inverse_model_view.m[2][2] * plane.z);
+            face_normal = vec3_mul(face_normal, orientation);
+            vec3_normalize(&face_normal);
+
+            // Create a polygon from the original triangle to be clipped
+            polygon_t polygon = create_polygon_from_triangle(
+                vec3_from_vec4(transformed_vertices[0]),
+                vec3_from_vec4(transformed_vertices[1]),
+                vec3_from_vec4(transformed_vertices[2]),
+                face_uvs[0],
+                face_uvs[1],
+                face_uvs[2]);
+
+            // Clip the polygon from the original transformed triangle to be clipped
+            uint64_t clipping_start = profile_begin();
+            clip_polygon(&polygon);
+            profile_end(PROFILE_CLIPPING, clipping_start);
+
+            // Break the polygon apart back into individual triangles
+            triangle_t triangles_after_clipping[MAX_NUM_POLY_TRIANGLES];
+            int num_triangles_after_clipping = 0;
+
+            triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
+
+            // Loop the assembled triangles after clipping
+            for (int t = 0; t < num_triangles_after_clipping; t++)
             {
-                triangles_to_render[num_triangles_to_render++] = triangle_to_render;
+                triangle_t triangle_after_clipping = triangles_after_clipping[t];
+
+                vec4_t projected_points[3];
+
+                // Look all 3 vertices to perform projection
+                for (int j = 0; j < 3; j++)
+                {
+                    // Project the current vertex
+                    projected_points[j] = mat4_mul_vec4_project(proj_matrix, triangle_after_clipping.points[j]);
+
+                    // Perform perspective divide
+                    // if (projected_points[j].w != 0)
+                    // {
+                    //     projected_points[j].x /= projected_points[j].w;
+                    //     projected_points[j].y /= projected_points[j].w;
+                    //     projected_points[j].z /= projected_points[j].w;
+                    // }
+
+                    // Invert y values to account for flipped screen y coordinates.
+                    projected_points[j].y *= -1;
+
+                    // Scale projected points to half window size
+                    projected_points[j].x *= (get_window_width() / 2.0);
+                    projected_points[j].y *= (get_window_height() / 2.0);
+
+                    // Translate projected point to middle of screen
+                    projected_points[j].x += (get_window_width() / 2.0);
+                    projected_points[j].y += (get_window_height() / 2.0);
+                }
+
+                // Calculate shade intensity based on alignment of the triangle normal and the inverse of the light direction
+                float light_intensity_factor = -vec3_dot(face_normal, get_light_direction());
+
+                // Calculate triangle color based on light angle
+                uint32_t triangle_color = light_apply_intensity(mesh_face.color, light_intensity_factor);
+
+                // Set up the projected triangle in place at the end of the screen space triangles
+                triangles_to_render = array_hold(triangles_to_render, 1, sizeof(raster_triangle_t));
+                setup_raster_triangle(
+                    &triangles_to_render[array_length(triangles_to_render) - 1],
+                    projected_points, triangle_after_clipping.texcoords,
+                    triangle_color, mesh->texture);
+                num_triangles_to_render++;
             }
         }
     }
+
+    TRACE_END("geometry");
+    profile_end(PROFILE_GEOMETRY, geometry_start);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -344,7 +443,7 @@ void update(void)
     int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
 
     // Delay execution if going too fast
-    if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME)
+    if (!get_options()->uncapped && time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME)
     {
         SDL_Delay(time_to_wait);
     }
@@ -355,23 +454,58 @@ void update(void)
     // SDL_GetTicks returns number of ms since app started
     previous_frame_time = SDL_GetTicks();
 
+    // The benchmark uses a fixed timestep and a scripted camera so every run is identical
+    if (get_options()->bench)
+    {
+        delta_time = BENCH_DELTA_TIME;
+        update_benchmark_camera(frame_count);
+    }
+
+    // Start measuring the frame after the frame cap delay
+    profiler_begin_frame();
+    TRACE_BEGIN("frame");
+    TRACE_BEGIN("update");
+
     // Initialize the counter of triangles to render for this frame
+    array_clear(triangles_to_render);
     num_triangles_to_render = 0;
+    reset_frame_stats();
+
+    // Update camera look at target to create view matrix
+    vec3_t target = get_camera_lookat_target();
+    vec3_t up_direction = vec3_new(0, 1, 0);
+    view_matrix = mat4_look_at(get_camera_position(), target, up_direction);
+
+    // Meshes streamed in since the last frame join the scene before the BVH update
+    update_streaming();
+
+    // With every texture in, the scene textures are packed once into the atlas
+    build_texture_atlas();
+
+    // Bring the scene BVH up to date and flag the instances inside the frustum
+    // that are not hidden behind occluders
+    update_scene_bvh();
+    cull_scene_instances(view_matrix);
+    cull_occluded_instances(view_matrix, proj_matrix);
 
     // Loop through all the meshes on the scene (array of meshes)
     for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++)
     {
         mesh_t *mesh = get_mesh(mesh_index);
 
-        // Change the mesh rotation and scale values per frame.
-        // mesh.rotation.x += 0.1 * delta_time;
-        // mesh.rotation.y += 0.1 * delta_time;
-        // mesh.rotation.z += 0.1 * delta_time;
-        // mesh.translation.z = 5.0;
+        // Process every instance of the mesh back to back while its
+        // vertices and faces are still in cache
+        for (int i = 0; i < array_length(mesh->instances); i++)
+        {
+            if (!mesh->instances[i].visible)
+                continue;
 
-        // Process the graphics pipeline stages for every mesh of the 3D scene
-        process_graphic_pipeline_stages(mesh);
+            // Process the graphics pipeline stages for every instance of the 3D scene
+            process_graphic_pipeline_stages(mesh, &mesh->instances[i], mesh_index);
+        }
     }
+
+    TRACE_END("update");
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -379,58 +513,107 @@ void update(void)
 ////////////////////////////////////////////////////////////////////
 void render(void)
 {
+    TRACE_BEGIN("render");
+
     // Clear the buffers to prepare for the next frame
+    uint64_t clear_start = profile_begin();
     clear_color_buffer(0x00000000);
     clear_z_buffer();
+    profile_end(PROFILE_CLEAR, clear_start);
+
+    frame_stats.triangles_rendered += num_triangles_to_render;
+
+    if (should_render_overdraw())
+    {
+        clear_overdraw_buffer();
+    }
 
     // Loop projected points and render them
+    TRACE_BEGIN("raster");
     for (int i = 0; i < num_triangles_to_render; i++)
     {
-        triangle_t triangle = triangles_to_render[i];
+        const raster_triangle_t *triangle = &triangles_to_render[i];
+
+        // Count how many times every pixel is covered instead of drawing colors
+        if (should_render_overdraw())
+        {
+            uint64_t raster_start = profile_begin();
+            draw_overdraw_triangle(triangle);
+            profile_end(PROFILE_RASTER, raster_start);
+        }
+
+        // Meshes without a texture are drawn flat shaded in the textured modes
+        texture_t *texture = get_texture(triangle->texture);
+        bool has_texture = (texture != NULL);
 
         // Draw filled triangle faces
-        if (should_render_filled_triangle())
+        if (should_render_filled_triangle() || (should_render_textured_triangle() && !has_texture))
         {
-            draw_filled_triangle(
-                triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w,
-                triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w,
-                triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w,
-                triangle.color);
+            uint64_t raster_start = profile_begin();
+            draw_filled_triangle(triangle);
+            profile_end(PROFILE_RASTER, raster_start);
         }
 
         // Draw textured triangle
-        if (should_render_textured_triangle())
+        if (should_render_textured_triangle() && has_texture)
         {
-            draw_textured_triangle(
-                triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w, triangle.texcoords[0].u, triangle.texcoords[0].v, // vertex A
-                triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w, triangle.texcoords[1].u, triangle.texcoords[1].v, // vertex B
-                triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w, triangle.texcoords[2].u, triangle.texcoords[2].v, // vertex C
-                triangle.texture);
+            uint64_t raster_start = profile_begin();
+            draw_textured_triangle(triangle, texture, get_texture_rect(triangle->texture_rect));
+            profile_end(PROFILE_RASTER, raster_start);
         }
 
         // Draw unfilled triangle edges
         if (should_render_wireframe())
         {
             draw_triangle(
-                triangle.points[0].x,
-                triangle.points[0].y,
-                triangle.points[1].x,
-                triangle.points[1].y,
-                triangle.points[2].x,
-                triangle.points[2].y,
+                get_raster_pixel(triangle->x[0]),
+                get_raster_pixel(triangle->y[0]),
+                get_raster_pixel(triangle->x[1]),
+                get_raster_pixel(triangle->y[1]),
+                get_raster_pixel(triangle->x[2]),
+                get_raster_pixel(triangle->y[2]),
                 0xFF00FF00);
         }
 
         // Draw vertex points
         if (should_render_wire_vertex())
         {
-            draw_rect(triangle.points[0].x - 3, triangle.points[0].y - 3, 6, 6, 0xFFFF0000);
-            draw_rect(triangle.points[1].x - 3, triangle.points[1].y - 3, 6, 6, 0xFFFF0000);
-            draw_rect(triangle.points[2].x - 3, triangle.points[2].y - 3, 6, 6, 0xFFFF0000);
+            draw_rect((float)triangle->x[0] / RASTER_SUBPIXEL_SCALE - 3, (float)triangle->y[0] / RASTER_SUBPIXEL_SCALE - 3, 6, 6, 0xFFFF0000);
+            draw_rect((float)triangle->x[1] / RASTER_SUBPIXEL_SCALE - 3, (float)triangle->y[1] / RASTER_SUBPIXEL_SCALE - 3, 6, 6, 0xFFFF0000);
+            draw_rect((float)triangle->x[2] / RASTER_SUBPIXEL_SCALE - 3, (float)triangle->y[2] / RASTER_SUBPIXEL_SCALE - 3, 6, 6, 0xFFFF0000);
         }
     }
 
+    TRACE_END("raster");
+
+    // Turn the per-pixel coverage counts into heatmap colors
+    if (should_render_overdraw())
+    {
+        draw_overdraw_heatmap();
+    }
+
+    // Overlay the stage timings of the previous frame
+    draw_profiler_hud();
+
+    uint64_t present_start = profile_begin();
+    TRACE_BEGIN("present");
     render_color_buffer();
+    TRACE_END("present");
+    profile_end(PROFILE_PRESENT, present_start);
+
+    TRACE_END("render");
+    TRACE_END("frame");
+    trace_end_frame();
+    profiler_end_frame();
+}
+
+////////////////////////////////////////////////////////////////////
+// Render a single frame for the golden-image harness
+////////////////////////////////////////////////////////////////////
+void render_golden_frame(void)
+{
+    update();
+    render();
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -438,23 +621,112 @@ void render(void)
 ////////////////////////////////////////////////////////////////////
 void free_resources(void)
 {
+    free_streaming();
     free_meshes();
+    free_assets();
+    free_texture_atlas();
+    free_texture_table();
+    free_scene_bvh();
+    free_occlusion();
+    array_free(triangles_to_render);
+    free_benchmark();
+    free_profiler();
+    free_trace();
     destroy_window();
 }
 
 ////////////////////////////////////////////////////////////////////
 // Main function (entry point of application).
 ////////////////////////////////////////////////////////////////////
-int main(void)
+int main(int argc, char *argv[])
 {
-    is_running = initialize_window();
+    if (!parse_options(argc, argv))
+    {
+        return 1;
+    }
+    const options_t *options = get_options();
+
+    // Pick the display backend: an SDL window or an offscreen framebuffer
+    if (options->headless)
+    {
+        is_running = initialize_headless_window(options->width, options->height);
+    }
+    else
+    {
+        is_running = initialize_window();
+    }
+    set_frame_output(options->frame_output);
+    init_profiler(options->profile_hud, options->profile_csv);
+    init_occlusion(!options->no_occlusion);
+    init_lod(!options->no_lod);
+    init_mesh_cache(options->cache_dir);
+    init_texture_cache(options->cache_dir);
+    init_vertex_cache_optimization(!options->no_reorder);
+    init_vertex_quantization(options->quantize_vertices);
+    init_texture_compression(options->compress_textures);
+    init_texture_atlas(options->texture_atlas);
+    init_streaming(options->stream);
+
+    // A trace requested on the command line also covers loading the scene
+    init_trace(options->trace_file);
+    if (options->trace_file != NULL)
+    {
+        start_trace_capture(options->trace_frames);
+    }
+
     setup();
+    if (!is_running)
+    {
+        free_resources();
+        return 1;
+    }
+    if (options->mesh_report || options->asset_report)
+    {
+        wait_for_streaming();
+    }
+    if (options->mesh_report)
+    {
+        print_mesh_report();
+    }
+    if (options->asset_report)
+    {
+        print_asset_report();
+    }
+
+    // The golden-image harness drives update and render itself
+    if (options->golden_dir != NULL)
+    {
+        int num_failed = run_golden_tests(options->golden_dir, options->golden_update, options->golden_tolerance, render_golden_frame);
+        free_resources();
+        return num_failed > 0 ? 1 : 0;
+    }
 
     while (is_running)
     {
-        process_input();
+        // There are no input events to poll without a window
+        if (!is_headless())
+        {
+            process_input();
+        }
+        uint64_t frame_start_time = get_time_ns();
         update();
         render();
+        if (options->bench)
+        {
+            record_benchmark_frame(get_time_ns() - frame_start_time);
+        }
+
+        // Stop after the requested number of frames (0 keeps running until quit)
+        frame_count++;
+        if (options->max_frames > 0 && frame_count >= options->max_frames)
+        {
+            is_running = false;
+        }
+    }
+
+    if (options->bench)
+    {
+        write_benchmark_report(options->bench_csv);
     }
 
     free_resources();
@@ -162,4 +162,45 @@ mat4_t mat4_look_at(vec3_t eye, vec3_t target, vec3_t up)
                            {z.x, z.y, z.z, -vec3_dot(z, eye)},
                            {0, 0, 0, 1}}};
     return view_matrix;
+}
+
+float mat4_determinant_3x3(mat4_t m)
+{
+    return m.m[0][0] * (m.m[1][1] * m.m[2][2] - m.m[1][2] * m.m[2][1]) -
+           m.m[0][1] * (m.m[1][0] * m.m[2][2] - m.m[1][2] * m.m[2][0]) +
+           m.m[0][2] * (m.m[1][0] * m.m[2][1] - m.m[1][1] * m.m[2][0]);
+}
+
+float mat4_max_scale_3x3(mat4_t m)
+{
+    float max_scale = 0;
+    for (int j = 0; j < 3; j++)
+    {
+        vec3_t axis = vec3_new(m.m[0][j], m.m[1][j], m.m[2][j]);
+        max_scale = fmaxf(max_scale, vec3_length(axis));
+    }
+    return max_scale;
+}
+
+mat4_t mat4_inverse_affine(mat4_t m)
+{
+    // Inverse of the 3x3 part from its cofactors
+    float inv_det = 1.0 / mat4_determinant_3x3(m);
+    mat4_t inverse = mat4_identity();
+    inverse.m[0][0] = (m.m[1][1] * m.m[2][2] - m.m[1][2] * m.m[2][1]) * inv_det;
+    inverse.m[0][1] = (m.m[0][2] * m.m[2][1] - m.m[0][1] * m.m[2][2]) * inv_det;
+    inverse.m[0][2] = (m.m[0][1] * m.m[1][2] - m.m[0][2] * m.m[1][1]) * inv_det;
+    inverse.m[1][0] = (m.m[1][2] * m.m[2][0] - m.m[1][0] * m.m[2][2]) * inv_det;
+    inverse.m[1][1] = (m.m[0][0] * m.m[2][2] - m.m[0][2] * m.m[2][0]) * inv_det;
+    inverse.m[1][2] = (m.m[0][2] * m.m[1][0] - m.m[0][0] * m.m[1][2]) * inv_det;
+    inverse.m[2][0] = (m.m[1][0] * m.m[2][1] - m.m[1][1] * m.m[2][0]) * inv_det;
+    inverse.m[2][1] = (m.m[0][1] * m.m[2][0] - m.m[0][0] * m.m[2][1]) * inv_det;
+    inverse.m[2][2] = (m.m[0][0] * m.m[1][1] - m.m[0][1] * m.m[1][0]) * inv_det;
+
+    // The translation goes back through the inverted 3x3 part
+    for (int i = 0; i < 3; i++)
+    {
+        inverse.m[i][3] = -(inverse.m[i][0] * m.m[0][3] + inverse.m[i][1] * m.m[1][3] + inverse.m[i][2] * m.m[2][3]);
+    }
+    return inverse;
 }
\ No newline at end of file
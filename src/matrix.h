@@ -30,4 +30,13 @@ mat4_t mat4_mul_mat4(mat4_t a, mat4_t b);
 
 mat4_t mat4_look_at(vec3_t eye, vec3_t target, vec3_t up);
 
+// Determinant of the upper 3x3 part, negative when the matrix mirrors
+float mat4_determinant_3x3(mat4_t m);
+
+// Largest length the upper 3x3 part gives to a unit axis
+float mat4_max_scale_3x3(mat4_t m);
+
+// Inverse of a matrix whose last row is 0 0 0 1
+mat4_t mat4_inverse_affine(mat4_t m);
+
 #endif
\ No newline at end of file
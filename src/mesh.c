@@ -1,47 +1,396 @@
+#define _POSIX_C_SOURCE 200809L // strdup
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "array.h"
 #include "mesh.h"
+#include "asset.h"
+#include "lod.h"
+#include "meshcache.h"
+#include "quantize.h"
+#include "texcache.h"
+#include "timer.h"
+#include "trace.h"
+#include "vertexcache.h"
 
-#define MAX_NUM_MESHES 10
-static mesh_t meshes[MAX_NUM_MESHES];
-static int mesh_count = 0;
+// Dynamic array of all the meshes of the scene
+static mesh_t *meshes = NULL;
+static int mesh_table_version = 0;
 
-void load_mesh(char *obj_filename, char *png_filename, vec3_t scale, vec3_t translation, vec3_t rotation)
+static aabb_t compute_mesh_bounds(const mesh_t *mesh)
 {
-    if (mesh_count >= MAX_NUM_MESHES)
+    aabb_t bounds = {vec3_new(0, 0, 0), vec3_new(0, 0, 0)};
+    for (int i = 0; i < array_length(mesh->vertices); i++)
+    {
+        vec3_t v = mesh->vertices[i].position;
+        if (i == 0)
+        {
+            bounds.min = bounds.max = v;
+            continue;
+        }
+        bounds.min = vec3_new(fminf(bounds.min.x, v.x), fminf(bounds.min.y, v.y), fminf(bounds.min.z, v.z));
+        bounds.max = vec3_new(fmaxf(bounds.max.x, v.x), fmaxf(bounds.max.y, v.y), fmaxf(bounds.max.z, v.z));
+    }
+    return bounds;
+}
+
+////////////////////////////////////////////////////////////////////
+// Plane of every face in model space, so the geometry stage can cull
+// back faces against the camera position before transforming them.
+// The normal has the winding of get_triangle_normal().
+////////////////////////////////////////////////////////////////////
+static void compute_face_planes(mesh_lod_t *lod, const vertex_t *vertices)
+{
+    for (int i = 0; i < array_length(lod->faces); i++)
+    {
+        vec3_t a = vertices[lod->faces[i].a].position;
+        vec3_t b = vertices[lod->faces[i].b].position;
+        vec3_t c = vertices[lod->faces[i].c].position;
+        vec3_t normal = vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+        if (vec3_length(normal) > 0)
+            vec3_normalize(&normal);
+
+        vec4_t plane = {normal.x, normal.y, normal.z, -vec3_dot(normal, a)};
+        array_push(lod->face_planes, plane);
+    }
+}
+
+static size_t get_mesh_geometry_memory(const mesh_t *mesh)
+{
+    size_t memory = array_length(mesh->vertices) * sizeof(vertex_t) +
+                    array_length(mesh->quantized_vertices) * sizeof(quantized_vertex_t);
+    for (int i = 0; i < mesh->num_lods; i++)
+    {
+        memory += array_length(mesh->lods[i].faces) * (sizeof(face_t) + sizeof(vec4_t)) +
+                  array_length(mesh->lods[i].meshlets) * sizeof(meshlet_t);
+    }
+    return memory;
+}
+
+// Copy the geometry fields of one mesh into another, which then shares the arrays
+static void share_mesh_geometry(mesh_t *mesh, const mesh_t *geometry)
+{
+    mesh->vertices = geometry->vertices;
+    mesh->quantized_vertices = geometry->quantized_vertices;
+    mesh->dequantize_matrix = geometry->dequantize_matrix;
+    mesh->uv_offset = geometry->uv_offset;
+    mesh->uv_step = geometry->uv_step;
+    memcpy(mesh->lods, geometry->lods, sizeof(mesh->lods));
+    mesh->num_lods = geometry->num_lods;
+    mesh->bounds = geometry->bounds;
+    mesh->report = geometry->report;
+}
+
+static void free_mesh_geometry(mesh_t *mesh)
+{
+    for (int lod = 0; lod < mesh->num_lods; lod++)
+    {
+        array_free(mesh->lods[lod].faces);
+        array_free(mesh->lods[lod].face_planes);
+        array_free(mesh->lods[lod].meshlets);
+    }
+    array_free(mesh->vertices);
+    array_free(mesh->quantized_vertices);
+    memset(mesh->lods, 0, sizeof(mesh->lods));
+    mesh->vertices = NULL;
+    mesh->quantized_vertices = NULL;
+    mesh->num_lods = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+// Geometry and texture come from the asset registry when another mesh
+// already loaded the same files; otherwise they are loaded and
+// registered for the next meshes. The geometry is loaded in two steps
+// so a mesh streamed in the background can show its bounds early: the
+// first reads the cache or parses the OBJ file, the second generates
+// the levels of detail and meshlets of a parsed file (num_lods is
+// still 0 then) and registers the result.
+////////////////////////////////////////////////////////////////////
+uint64_t begin_mesh_geometry(mesh_t *mesh, char *obj_filename)
+{
+    mesh->geometry_asset = acquire_asset(ASSET_GEOMETRY, obj_filename);
+    if (mesh->geometry_asset >= 0)
+    {
+        share_mesh_geometry(mesh, &get_asset(mesh->geometry_asset)->geometry);
+        return 0;
+    }
+
+    uint64_t start = get_time_ns();
+    if (!read_mesh_cache(obj_filename, mesh))
+    {
+        load_mesh_obj_data(mesh, obj_filename);
+        mesh->report.source_acmr = compute_acmr(mesh->lods[0].faces);
+    }
+    mesh->bounds = compute_mesh_bounds(mesh);
+    return get_time_ns() - start;
+}
+
+void finish_mesh_geometry(mesh_t *mesh, char *obj_filename, uint64_t begin_ns)
+{
+    if (mesh->geometry_asset >= 0)
         return;
 
-    //  Load obj file and png file
-    load_mesh_obj_data(&meshes[mesh_count], obj_filename);
-    load_mesh_png_data(&meshes[mesh_count], png_filename);
+    uint64_t start = get_time_ns();
+    if (mesh->num_lods == 0)
+    {
+        generate_mesh_lods(mesh);
+        for (int i = 0; i < mesh->num_lods; i++)
+            mesh->lods[i].meshlets = build_meshlets(mesh->lods[i].faces, mesh->vertices, array_length(mesh->vertices));
+        if (is_vertex_cache_optimization_enabled())
+            optimize_mesh_vertex_order(mesh);
+        mesh->report.optimized_acmr = compute_acmr(mesh->lods[0].faces);
+        write_mesh_cache(obj_filename, mesh);
+    }
+    for (int i = 0; i < mesh->num_lods; i++)
+        compute_face_planes(&mesh->lods[i], mesh->vertices);
+    if (is_vertex_quantization_enabled())
+        quantize_mesh_vertices(mesh);
+
+    float load_ms = (begin_ns + get_time_ns() - start) / 1e6;
+    mesh->geometry_asset = register_asset(ASSET_GEOMETRY, obj_filename, get_mesh_geometry_memory(mesh), load_ms);
+    if (mesh->geometry_asset >= 0)
+        share_mesh_geometry(&get_asset(mesh->geometry_asset)->geometry, mesh);
+}
 
-    //  Initialize scale, translation, rotation with given parameters
-    meshes[mesh_count].scale = scale;
-    meshes[mesh_count].translation = translation;
-    meshes[mesh_count].rotation = rotation;
+void load_mesh_texture(mesh_t *mesh, char *png_filename)
+{
+    mesh->texture_asset = acquire_asset(ASSET_TEXTURE, png_filename);
+    if (mesh->texture_asset >= 0)
+    {
+        mesh->texture = get_asset(mesh->texture_asset)->texture;
+        return;
+    }
+
+    uint64_t start = get_time_ns();
+    load_mesh_png_data(mesh, png_filename);
+    float load_ms = (get_time_ns() - start) / 1e6;
+    if (mesh->texture != NULL)
+    {
+        mesh->texture_asset = register_asset(ASSET_TEXTURE, png_filename, get_texture_memory(mesh->texture), load_ms);
+        if (mesh->texture_asset >= 0)
+            get_asset(mesh->texture_asset)->texture = mesh->texture;
+    }
+}
+
+int load_mesh(char *obj_filename, char *png_filename)
+{
+    mesh_t mesh = {0};
+    mesh.name = strdup(obj_filename);
+
+    TRACE_BEGIN_ID("load_mesh", array_length(meshes));
+    uint64_t begin_ns = begin_mesh_geometry(&mesh, obj_filename);
+    finish_mesh_geometry(&mesh, obj_filename, begin_ns);
+    load_mesh_texture(&mesh, png_filename);
+    TRACE_END("load_mesh");
+
+    // The texture table is only touched by the main thread
+    if (mesh.texture != NULL)
+        register_texture(mesh.texture);
 
     //  Add the created mesh to array of meshes
-    mesh_count++;
+    array_push(meshes, mesh);
+    mesh_table_version++;
+    return array_length(meshes) - 1;
+}
+
+int add_pending_mesh(char *obj_filename)
+{
+    mesh_t mesh = {0};
+    mesh.name = strdup(obj_filename);
+    mesh.geometry_asset = -1;
+    mesh.texture_asset = -1;
+    array_push(meshes, mesh);
+    mesh_table_version++;
+    return array_length(meshes) - 1;
+}
+
+////////////////////////////////////////////////////////////////////
+// The placeholder is the bounding box of the mesh, with faces wound
+// like loaded ones so it is culled and shaded the same way.
+////////////////////////////////////////////////////////////////////
+void set_mesh_placeholder(int mesh_index, aabb_t bounds)
+{
+    static const int box_faces[12][3] = {
+        {0, 1, 3}, {0, 3, 2}, {4, 6, 7}, {4, 7, 5}, {0, 4, 5}, {0, 5, 1},
+        {2, 3, 7}, {2, 7, 6}, {0, 2, 6}, {0, 6, 4}, {1, 5, 7}, {1, 7, 3}};
+
+    mesh_t *mesh = &meshes[mesh_index];
+    free_mesh_geometry(mesh);
+    for (int i = 0; i < 8; i++)
+    {
+        vertex_t vertex = {0};
+        vertex.position = vec3_new(
+            (i & 1) ? bounds.max.x : bounds.min.x,
+            (i & 2) ? bounds.max.y : bounds.min.y,
+            (i & 4) ? bounds.max.z : bounds.min.z);
+        array_push(mesh->vertices, vertex);
+    }
+
+    vec3_t center = vec3_mul(vec3_add(bounds.min, bounds.max), 0.5);
+    for (int i = 0; i < 12; i++)
+    {
+        face_t face = {box_faces[i][0], box_faces[i][1], box_faces[i][2], MESH_PLACEHOLDER_COLOR};
+        vec3_t a = mesh->vertices[face.a].position;
+        vec3_t b = mesh->vertices[face.b].position;
+        vec3_t c = mesh->vertices[face.c].position;
+        vec3_t centroid = vec3_div(vec3_add(vec3_add(a, b), c), 3.0);
+        if (vec3_dot(vec3_cross(vec3_sub(b, a), vec3_sub(c, a)), vec3_sub(centroid, center)) < 0)
+        {
+            face.b = box_faces[i][2];
+            face.c = box_faces[i][1];
+        }
+        array_push(mesh->lods[0].faces, face);
+    }
+    mesh->num_lods = 1;
+    mesh->lods[0].meshlets = build_meshlets(mesh->lods[0].faces, mesh->vertices, array_length(mesh->vertices));
+    compute_face_planes(&mesh->lods[0], mesh->vertices);
+    mesh->bounds = bounds;
+    mesh->is_placeholder = true;
+    mesh_table_version++;
+}
+
+void set_mesh_geometry(int mesh_index, const mesh_t *geometry)
+{
+    mesh_t *mesh = &meshes[mesh_index];
+    if (mesh->geometry_asset < 0)
+        free_mesh_geometry(mesh);
+    share_mesh_geometry(mesh, geometry);
+    mesh->geometry_asset = geometry->geometry_asset;
+    mesh->is_placeholder = false;
+    mesh_table_version++;
+}
+
+void set_mesh_texture(int mesh_index, texture_t *texture, int texture_asset)
+{
+    if (texture != NULL)
+        register_texture(texture);
+    meshes[mesh_index].texture = texture;
+    meshes[mesh_index].texture_asset = texture_asset;
+}
+
+void add_mesh_instance(int mesh_index, vec3_t scale, vec3_t translation, vec3_t rotation)
+{
+    //  Initialize scale, translation, rotation with given parameters
+    mesh_instance_t instance = {
+        .rotation = rotation,
+        .scale = scale,
+        .translation = translation,
+        .moved = false,
+        .bvh_ref = -1,
+        .visible = true,
+        .lod = 0};
+    array_push(meshes[mesh_index].instances, instance);
+    mesh_table_version++;
+}
+
+mat4_t get_mesh_instance_world_matrix(const mesh_instance_t *instance)
+{
+    // Create a scale matrix to multiply the mesh vertices
+    mat4_t scale_matrix = mat4_make_scale(instance->scale.x, instance->scale.y, instance->scale.z);
+    mat4_t translation_matrix = mat4_make_translation(instance->translation.x, instance->translation.y, instance->translation.z);
+    mat4_t rotation_matrix_x = mat4_make_rotation_x(instance->rotation.x);
+    mat4_t rotation_matrix_y = mat4_make_rotation_y(instance->rotation.y);
+    mat4_t rotation_matrix_z = mat4_make_rotation_z(instance->rotation.z);
+
+    // Create a World Matrix combining scale, rotation and translation matrices
+    mat4_t world_matrix = mat4_identity();
+    // Order matters. Scale -> Rotation -> Translation. [T]*[R]*[S]*v
+    world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
+    world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
+    world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
+    world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
+    world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
+    return world_matrix;
+}
+
+////////////////////////////////////////////////////////////////////
+// Open addressing hash table from vertex contents to their index in
+// the vertex array of the mesh being loaded. Vertices are compared
+// bytewise, which only misses merging 0 and -0.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    int *slots; // Vertex index, or -1 when empty
+    int capacity;
+    int count;
+} vertex_map_t;
+
+static uint32_t hash_vertex(const vertex_t *vertex)
+{
+    // FNV-1a
+    const unsigned char *bytes = (const unsigned char *)vertex;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(vertex_t); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+static void vertex_map_grow(vertex_map_t *map, const vertex_t *vertices)
+{
+    int capacity = map->capacity > 0 ? map->capacity * 2 : 1024;
+    int *slots = (int *)malloc(sizeof(int) * capacity);
+    for (int i = 0; i < capacity; i++)
+        slots[i] = -1;
+    for (int i = 0; i < map->capacity; i++)
+    {
+        if (map->slots[i] < 0)
+            continue;
+        uint32_t slot = hash_vertex(&vertices[map->slots[i]]) & (capacity - 1);
+        while (slots[slot] >= 0)
+            slot = (slot + 1) & (capacity - 1);
+        slots[slot] = map->slots[i];
+    }
+    free(map->slots);
+    map->slots = slots;
+    map->capacity = capacity;
+}
+
+// Index of the vertex in the array, appended if it is not there yet
+static int add_unique_vertex(vertex_map_t *map, vertex_t **vertices, vertex_t vertex)
+{
+    if ((map->count + 1) * 2 > map->capacity)
+        vertex_map_grow(map, *vertices);
+
+    uint32_t slot = hash_vertex(&vertex) & (map->capacity - 1);
+    while (map->slots[slot] >= 0)
+    {
+        if (memcmp(&(*vertices)[map->slots[slot]], &vertex, sizeof(vertex_t)) == 0)
+            return map->slots[slot];
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+
+    map->slots[slot] = array_length(*vertices);
+    map->count++;
+    array_push(*vertices, vertex);
+    return map->slots[slot];
 }
 
 void load_mesh_obj_data(mesh_t *mesh, char *obj_filename)
 {
+    TRACE_BEGIN("parse_obj");
     FILE *file;
     file = fopen(obj_filename, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening mesh %s.\n", obj_filename);
+        TRACE_END("parse_obj");
+        return;
+    }
 
     char line[1024];
+    vec3_t *positions = NULL;
     tex2_t *texcoords = NULL;
+    vertex_map_t vertex_map = {NULL, 0, 0};
 
     while (fgets(line, 1024, file))
     {
         // Line is vertex line
         if (strncmp(line, "v ", 2) == 0)
         {
-            vec3_t vertex;
-            sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-            array_push(mesh->vertices, vertex);
+            vec3_t position;
+            sscanf(line, "v %f %f %f", &position.x, &position.y, &position.z);
+            array_push(positions, position);
         }
         // Line is uv line
         if (strncmp(line, "vt ", 3) == 0)
@@ -53,44 +402,104 @@ void load_mesh_obj_data(mesh_t *mesh, char *obj_filename)
         // Line is face line
         if (strncmp(line, "f ", 2) == 0)
         {
-            int vertex_indices[3];
-            int texture_indices[3];
-            int normal_indices[3];
+            int vertex_indices[3] = {0};
+            int texture_indices[3] = {0};
+            int normal_indices[3] = {0};
             sscanf(
                 line, "f %d/%d/%d %d/%d/%d %d/%d/%d",
                 &vertex_indices[0], &texture_indices[0], &normal_indices[0],
                 &vertex_indices[1], &texture_indices[1], &normal_indices[1],
                 &vertex_indices[2], &texture_indices[2], &normal_indices[2]);
+
+            // Corners sharing position and uv share one vertex, the normal index is not used
+            int corners[3];
+            for (int i = 0; i < 3; i++)
+            {
+                vertex_t vertex = {0};
+                if (vertex_indices[i] >= 1 && vertex_indices[i] <= array_length(positions))
+                    vertex.position = positions[vertex_indices[i] - 1];
+                if (texture_indices[i] >= 1 && texture_indices[i] <= array_length(texcoords))
+                    vertex.uv = texcoords[texture_indices[i] - 1];
+                corners[i] = add_unique_vertex(&vertex_map, &mesh->vertices, vertex);
+            }
             face_t face = {
-                .a = vertex_indices[0] - 1,
-                .b = vertex_indices[1] - 1,
-                .c = vertex_indices[2] - 1,
-                .a_uv = texcoords[texture_indices[0] - 1],
-                .b_uv = texcoords[texture_indices[1] - 1],
-                .c_uv = texcoords[texture_indices[2] - 1],
+                .a = corners[0],
+                .b = corners[1],
+                .c = corners[2],
                 .color = 0xFFFFFF};
-            array_push(mesh->faces, face);
+            array_push(mesh->lods[0].faces, face);
         }
     }
+    mesh->report.source_positions = array_length(positions);
+    free(vertex_map.slots);
+    array_free(positions);
     array_free(texcoords);
+    fclose(file);
+    TRACE_END("parse_obj");
 }
 
 void load_mesh_png_data(mesh_t *mesh, char *png_filename)
 {
+    // Meshes without a texture are rendered flat shaded
+    if (png_filename == NULL)
+        return;
+
+    // Pixels decoded by an earlier run are mapped from the texture cache
+    upng_t *cached_image = read_texture_cache(png_filename);
+    if (cached_image != NULL)
+    {
+        mesh->texture = create_texture(cached_image);
+        return;
+    }
+
     upng_t *png_image = upng_new_from_file(png_filename);
     if (png_image != NULL)
     {
+        TRACE_BEGIN("decode_png");
         upng_decode(png_image);
+        TRACE_END("decode_png");
         if (upng_get_error(png_image) == UPNG_EOK)
         {
-            mesh->texture = png_image;
+            write_texture_cache(png_filename, png_image);
+            mesh->texture = create_texture(png_image);
+        }
+        else
+        {
+            fprintf(stderr, "Error decoding texture %s.\n", png_filename);
+            upng_free(png_image);
         }
     }
 }
 
+////////////////////////////////////////////////////////////////////
+// Transform the model space box of the mesh into a world space box
+// that encloses it: the center goes through the world matrix and the
+// half extents through the absolute values of its 3x3 part.
+////////////////////////////////////////////////////////////////////
+aabb_t get_mesh_instance_bounds(const mesh_t *mesh, const mesh_instance_t *instance)
+{
+    mat4_t m = get_mesh_instance_world_matrix(instance);
+    vec3_t center = vec3_mul(vec3_add(mesh->bounds.min, mesh->bounds.max), 0.5);
+    vec3_t extents = vec3_mul(vec3_sub(mesh->bounds.max, mesh->bounds.min), 0.5);
+
+    vec3_t world_center = vec3_from_vec4(mat4_mul_vec4(m, vec4_from_vec3(center)));
+    vec3_t world_extents = vec3_new(
+        fabsf(m.m[0][0]) * extents.x + fabsf(m.m[0][1]) * extents.y + fabsf(m.m[0][2]) * extents.z,
+        fabsf(m.m[1][0]) * extents.x + fabsf(m.m[1][1]) * extents.y + fabsf(m.m[1][2]) * extents.z,
+        fabsf(m.m[2][0]) * extents.x + fabsf(m.m[2][1]) * extents.y + fabsf(m.m[2][2]) * extents.z);
+
+    aabb_t bounds = {vec3_sub(world_center, world_extents), vec3_add(world_center, world_extents)};
+    return bounds;
+}
+
+int get_mesh_num_vertices(const mesh_t *mesh)
+{
+    return mesh->quantized_vertices != NULL ? array_length(mesh->quantized_vertices) : array_length(mesh->vertices);
+}
+
 int get_num_meshes(void)
 {
-    return mesh_count;
+    return array_length(meshes);
 }
 
 mesh_t *get_mesh(int index)
@@ -98,12 +507,56 @@ mesh_t *get_mesh(int index)
     return &meshes[index];
 }
 
+int get_mesh_table_version(void)
+{
+    return mesh_table_version;
+}
+
+////////////////////////////////////////////////////////////////////
+// Geometry memory is compared with the layout before vertices were
+// indexed: an array of the OBJ positions, and faces holding three
+// position indices and three texture coordinates each. Quantization
+// errors are only known for meshes quantized at load.
+////////////////////////////////////////////////////////////////////
+void print_mesh_report(void)
+{
+    const size_t unindexed_face_size = 3 * sizeof(int) + 3 * sizeof(tex2_t) + sizeof(uint32_t);
+    for (int i = 0; i < array_length(meshes); i++)
+    {
+        const mesh_t *mesh = &meshes[i];
+        int num_faces = 0;
+        for (int lod = 0; lod < mesh->num_lods; lod++)
+            num_faces += array_length(mesh->lods[lod].faces);
+        size_t unindexed_size = mesh->report.source_positions * sizeof(vec3_t) + num_faces * unindexed_face_size;
+        size_t vertex_size = mesh->quantized_vertices != NULL ? sizeof(quantized_vertex_t) : sizeof(vertex_t);
+        size_t indexed_size = get_mesh_num_vertices(mesh) * vertex_size + num_faces * sizeof(face_t);
+
+        printf("%s: %d vertices from %d positions, %d faces, %d levels of detail, %d meshlets, ACMR %.3f -> %.3f, "
+               "geometry %.1f KB -> %.1f KB",
+               mesh->name, get_mesh_num_vertices(mesh), mesh->report.source_positions, array_length(mesh->lods[0].faces),
+               mesh->num_lods, array_length(mesh->lods[0].meshlets), mesh->report.source_acmr, mesh->report.optimized_acmr,
+               unindexed_size / 1024.0, indexed_size / 1024.0);
+        if (mesh->quantized_vertices != NULL)
+            printf(", quantized (position error %g)", mesh->report.position_error);
+        printf("\n");
+    }
+}
+
 void free_meshes(void)
 {
-    for (int i = 0; i < mesh_count; i++)
+    for (int i = 0; i < array_length(meshes); i++)
     {
-        upng_free(meshes[i].texture);
-        array_free(meshes[i].faces);
-        array_free(meshes[i].vertices);
+        // Shared data goes with the last mesh releasing it
+        if (meshes[i].texture != NULL && (meshes[i].texture_asset < 0 || release_asset(meshes[i].texture_asset)))
+            free_texture(meshes[i].texture);
+        if (meshes[i].geometry_asset < 0 || release_asset(meshes[i].geometry_asset))
+            free_mesh_geometry(&meshes[i]);
+        array_free(meshes[i].instances);
+        free(meshes[i].name);
     }
+
+    // Leave the mesh table empty so a new scene can be loaded
+    array_free(meshes);
+    meshes = NULL;
+    mesh_table_version++;
 }
\ No newline at end of file
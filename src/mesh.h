@@ -1,33 +1,136 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "vector.h"
+#include "matrix.h"
 #include "triangle.h"
 #include "upng.h"
+#include "meshlet.h"
 
 ////////////////////////////////////////////////////////////////////
-// Define a struct for a dynamic sized mesh.
+// Axis aligned bounding box
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    vec3_t min;
+    vec3_t max;
+} aabb_t;
+
+////////////////////////////////////////////////////////////////////
+// Placement of one copy of a mesh in the scene. Code that changes the
+// transform of an existing instance must call mark_instance_moved so
+// the scene BVH refits its bounds.
 ////////////////////////////////////////////////////////////////////
 typedef struct
 {
-    vec3_t *vertices;   // Dynamic array of vertices
-    face_t *faces;      // Dynamic array of faces
-    upng_t *texture;    // Mesh PNG texture pointer
     vec3_t rotation;    // Rotation as x,y,z euler angles.
     vec3_t scale;       // Scale with x,y,z values
     vec3_t translation; // Translation with x,y,z values.
+    bool moved;         // Transform changed since the BVH was last updated
+    int bvh_ref;        // Reference in the scene BVH, -1 until the next rebuild
+    bool visible;       // Inside the view frustum this frame
+    int lod;            // Level of detail drawn, kept between frames for hysteresis
+} mesh_instance_t;
+
+////////////////////////////////////////////////////////////////////
+// One level of detail of a mesh. Every level indexes the vertices of
+// the mesh, only the face list gets shorter. Faces are ordered by
+// meshlet, each meshlet covering a range of them.
+////////////////////////////////////////////////////////////////////
+#define MAX_MESH_LODS 4
+
+typedef struct
+{
+    face_t *faces;       // Dynamic array of faces
+    vec4_t *face_planes; // Model space plane of each face: unit normal in xyz, offset in w
+    meshlet_t *meshlets; // Dynamic array of face clusters
+    float error;         // Model space distance the level may stray from full detail
+} mesh_lod_t;
+
+////////////////////////////////////////////////////////////////////
+// Figures of the load time processing, printed by --mesh-report
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    int source_positions; // Position entries of the OBJ file
+    float source_acmr;    // Vertex cache misses per face in file order
+    float optimized_acmr; // The same after the faces were reordered
+    float position_error; // Largest model space distance of a quantized position from the original
+} mesh_report_t;
+
+////////////////////////////////////////////////////////////////////
+// Define a struct for a dynamic sized mesh. The geometry and texture
+// are loaded once and shared by every instance placing the mesh.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    char *name;                       // OBJ file the mesh was loaded from
+    vertex_t *vertices;               // Dynamic array of unique vertices, NULL once quantized
+    quantized_vertex_t *quantized_vertices; // Dynamic array replacing vertices when quantization is on
+    mat4_t dequantize_matrix;         // Maps quantized positions to model space
+    tex2_t uv_offset;                 // uv of a quantized uv: offset + uv * step
+    tex2_t uv_step;
+    mesh_lod_t lods[MAX_MESH_LODS];   // Face lists from full detail (lods[0]) to coarsest
+    int num_lods;                     // Number of levels in use
+    texture_t *texture;               // Mesh texture, NULL when drawn flat shaded
+    int geometry_asset;               // Registry entry sharing the geometry, -1 when the mesh owns it
+    int texture_asset;                // Registry entry sharing the texture, -1 when the mesh owns it
+    aabb_t bounds;                    // Model space bounds of the vertices
+    bool is_occluder;                 // Rasterized into the occlusion buffer to hide other instances
+    bool is_placeholder;              // Geometry is the bounding box while the real one loads
+    mesh_instance_t *instances;       // Dynamic array of instances drawing this mesh
+    mesh_report_t report;
 } mesh_t;
 
-void load_mesh(char *obj_filename, char *png_filename, vec3_t scale, vec3_t translation, vec3_t rotation);
+#define MESH_PLACEHOLDER_COLOR 0xFF808080
+
+// Returns the index of the new mesh, which has no instances yet
+int load_mesh(char *obj_filename, char *png_filename);
+
+// Steps of load_mesh() filling a mesh outside the mesh table, so they
+// can run on a loader thread: the first one sets the bounds and
+// returns the nanoseconds it took
+uint64_t begin_mesh_geometry(mesh_t *mesh, char *obj_filename);
+void finish_mesh_geometry(mesh_t *mesh, char *obj_filename, uint64_t begin_ns);
+void load_mesh_texture(mesh_t *mesh, char *png_filename);
+
+// Returns the index of a new mesh with no geometry or texture yet
+int add_pending_mesh(char *obj_filename);
+
+// Draw a pending mesh as its bounding box
+void set_mesh_placeholder(int mesh_index, aabb_t bounds);
+
+// Hand the geometry (or texture) loaded by the steps above to a pending mesh
+void set_mesh_geometry(int mesh_index, const mesh_t *geometry);
+void set_mesh_texture(int mesh_index, texture_t *texture, int texture_asset);
+
+void add_mesh_instance(int mesh_index, vec3_t scale, vec3_t translation, vec3_t rotation);
+
+// World matrix of an instance: scale, then rotate around z, y, x, then translate
+mat4_t get_mesh_instance_world_matrix(const mesh_instance_t *instance);
+
+// World space box enclosing the model space bounds of the mesh placed by an instance
+aabb_t get_mesh_instance_bounds(const mesh_t *mesh, const mesh_instance_t *instance);
 
 void load_mesh_obj_data(mesh_t *mesh, char *obj_filename);
 
 void load_mesh_png_data(mesh_t *mesh, char *png_filename);
 
+// Length of the float or quantized vertex array, whichever the mesh uses
+int get_mesh_num_vertices(const mesh_t *mesh);
+
 int get_num_meshes(void);
 
 mesh_t *get_mesh(int index);
 
+// Incremented whenever meshes or instances are added or freed
+int get_mesh_table_version(void);
+
+// Print one line per mesh with the figures of its load time processing
+void print_mesh_report(void);
+
 void free_meshes(void);
 
 #endif
\ No newline at end of file
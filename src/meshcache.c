@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L // mkdir
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "meshcache.h"
+#include "array.h"
+#include "cachefile.h"
+#include "trace.h"
+#include "vertexcache.h"
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    int64_t source_size;  // Size of the OBJ file the cache was built from
+    uint64_t source_hash; // FNV-1a hash of the bytes of that OBJ file
+    uint32_t flags;       // Optional processing steps applied, MESH_CACHE_* bits
+    int32_t num_vertices;
+    int32_t num_lods;
+    mesh_report_t report;
+} mesh_cache_header_t;
+
+#define MESH_CACHE_VERTEX_ORDER 1
+
+typedef struct
+{
+    int32_t num_faces;
+    int32_t num_meshlets;
+    float error;
+} mesh_cache_lod_t;
+
+static const char *cache_directory = NULL;
+
+void init_mesh_cache(const char *directory)
+{
+    cache_directory = directory;
+}
+
+static bool get_source_identity(const char *obj_filename, mesh_cache_header_t *header)
+{
+    if (!hash_source_file(obj_filename, &header->source_size, &header->source_hash))
+        return false;
+
+    memcpy(header->magic, "MESH", 4);
+    header->version = MESH_CACHE_VERSION;
+    header->flags = is_vertex_cache_optimization_enabled() ? MESH_CACHE_VERTEX_ORDER : 0;
+    return true;
+}
+
+// Read count items into a dynamic array
+static bool read_array(FILE *file, void **array, int count, int item_size)
+{
+    if (count <= 0)
+        return count == 0;
+    *array = array_hold(*array, count, item_size);
+    return fread(*array, item_size, count, file) == (size_t)count;
+}
+
+bool read_mesh_cache(const char *obj_filename, mesh_t *mesh)
+{
+    mesh_cache_header_t expected = {0};
+    if (cache_directory == NULL || !get_source_identity(obj_filename, &expected))
+        return false;
+
+    char filename[1024];
+    get_cache_filename(cache_directory, obj_filename, "mesh", filename, sizeof(filename));
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return false;
+
+    TRACE_BEGIN("read_mesh_cache");
+    mesh_cache_header_t header;
+    mesh_cache_lod_t lods[MAX_MESH_LODS];
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 memcmp(header.magic, expected.magic, 4) == 0 &&
+                 header.version == expected.version &&
+                 header.source_size == expected.source_size &&
+                 header.source_hash == expected.source_hash &&
+                 header.flags == expected.flags &&
+                 header.num_lods >= 1 && header.num_lods <= MAX_MESH_LODS &&
+                 fread(lods, sizeof(mesh_cache_lod_t), header.num_lods, file) == (size_t)header.num_lods &&
+                 read_array(file, (void **)&mesh->vertices, header.num_vertices, sizeof(vertex_t));
+
+    for (int i = 0; valid && i < header.num_lods; i++)
+    {
+        valid = read_array(file, (void **)&mesh->lods[i].faces, lods[i].num_faces, sizeof(face_t)) &&
+                read_array(file, (void **)&mesh->lods[i].meshlets, lods[i].num_meshlets, sizeof(meshlet_t));
+        mesh->lods[i].error = lods[i].error;
+    }
+    fclose(file);
+    TRACE_END("read_mesh_cache");
+
+    // A stale or truncated cache file leaves the mesh empty for a fresh load
+    if (!valid)
+    {
+        array_free(mesh->vertices);
+        mesh->vertices = NULL;
+        for (int i = 0; i < MAX_MESH_LODS; i++)
+        {
+            array_free(mesh->lods[i].faces);
+            array_free(mesh->lods[i].meshlets);
+            mesh->lods[i].faces = NULL;
+            mesh->lods[i].meshlets = NULL;
+        }
+        return false;
+    }
+    mesh->num_lods = header.num_lods;
+    mesh->report = header.report;
+    return true;
+}
+
+void write_mesh_cache(const char *obj_filename, const mesh_t *mesh)
+{
+    mesh_cache_header_t header = {0};
+    if (cache_directory == NULL || array_length(mesh->vertices) == 0 || !get_source_identity(obj_filename, &header))
+        return;
+
+    // The directory may already exist, opening the file reports real failures
+    mkdir(cache_directory, 0755);
+
+    // Written aside and renamed into place, so a concurrent run never reads half a file
+    char filename[1024], temporary[1040];
+    get_cache_filename(cache_directory, obj_filename, "mesh", filename, sizeof(filename));
+    FILE *file = create_cache_file(filename, temporary, sizeof(temporary));
+    if (file == NULL)
+        return;
+
+    header.num_vertices = array_length(mesh->vertices);
+    header.num_lods = mesh->num_lods;
+    header.report = mesh->report;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; i < mesh->num_lods; i++)
+    {
+        mesh_cache_lod_t lod = {array_length(mesh->lods[i].faces), array_length(mesh->lods[i].meshlets), mesh->lods[i].error};
+        written = written && fwrite(&lod, sizeof(lod), 1, file) == 1;
+    }
+    written = written && fwrite(mesh->vertices, sizeof(vertex_t), array_length(mesh->vertices), file) == (size_t)array_length(mesh->vertices);
+    for (int i = 0; i < mesh->num_lods; i++)
+    {
+        written = written &&
+                  fwrite(mesh->lods[i].faces, sizeof(face_t), array_length(mesh->lods[i].faces), file) == (size_t)array_length(mesh->lods[i].faces) &&
+                  fwrite(mesh->lods[i].meshlets, sizeof(meshlet_t), array_length(mesh->lods[i].meshlets), file) == (size_t)array_length(mesh->lods[i].meshlets);
+    }
+    commit_cache_file(file, written, temporary, filename);
+}
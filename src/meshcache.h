@@ -0,0 +1,26 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdbool.h>
+#include "mesh.h"
+
+////////////////////////////////////////////////////////////////////
+// Binary cache of processed meshes. Parsing an OBJ file and building
+// its levels of detail is slow, so the result is written to the cache
+// directory and read back for as long as the size and FNV-1a hash of
+// the OBJ bytes, and the optional processing steps, match the ones
+// recorded in the cache file.
+// Bump MESH_CACHE_VERSION whenever the processing or layout changes.
+////////////////////////////////////////////////////////////////////
+#define MESH_CACHE_VERSION 7
+#define DEFAULT_CACHE_DIR "./cache"
+
+// NULL disables the cache
+void init_mesh_cache(const char *directory);
+
+// Fill the vertices and levels of detail of a mesh from its cache file
+bool read_mesh_cache(const char *obj_filename, mesh_t *mesh);
+
+void write_mesh_cache(const char *obj_filename, const mesh_t *mesh);
+
+#endif
@@ -0,0 +1,378 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "meshlet.h"
+#include "array.h"
+#include "clipping.h"
+#include "trace.h"
+
+static vec3_t get_face_normal(const face_t *face, const vertex_t *vertices)
+{
+    vec3_t a = vertices[face->a].position;
+    vec3_t normal = vec3_cross(vec3_sub(vertices[face->b].position, a), vec3_sub(vertices[face->c].position, a));
+    if (vec3_length(normal) > 0)
+        vec3_normalize(&normal);
+    return normal;
+}
+
+static vec3_t get_face_centroid(const face_t *face, const vertex_t *vertices)
+{
+    vec3_t sum = vec3_add(vec3_add(vertices[face->a].position, vertices[face->b].position), vertices[face->c].position);
+    return vec3_div(sum, 3.0);
+}
+
+////////////////////////////////////////////////////////////////////
+// Sphere around the box of the face corners, and the tightest cone
+// around the average of the face normals. Degenerate faces have no
+// normal; they never show on screen and are left out of the cone.
+////////////////////////////////////////////////////////////////////
+static void compute_meshlet_bounds(meshlet_t *meshlet, const face_t *faces, const vertex_t *vertices)
+{
+    vec3_t min = vertices[faces[meshlet->first_face].a].position;
+    vec3_t max = min;
+    vec3_t normal_sum = vec3_new(0, 0, 0);
+    for (int i = meshlet->first_face; i < meshlet->first_face + meshlet->num_faces; i++)
+    {
+        int corners[3] = {faces[i].a, faces[i].b, faces[i].c};
+        for (int j = 0; j < 3; j++)
+        {
+            vec3_t v = vertices[corners[j]].position;
+            min = vec3_new(fminf(min.x, v.x), fminf(min.y, v.y), fminf(min.z, v.z));
+            max = vec3_new(fmaxf(max.x, v.x), fmaxf(max.y, v.y), fmaxf(max.z, v.z));
+        }
+        normal_sum = vec3_add(normal_sum, get_face_normal(&faces[i], vertices));
+    }
+
+    meshlet->center = vec3_mul(vec3_add(min, max), 0.5);
+    meshlet->radius = 0;
+    for (int i = meshlet->first_face; i < meshlet->first_face + meshlet->num_faces; i++)
+    {
+        int corners[3] = {faces[i].a, faces[i].b, faces[i].c};
+        for (int j = 0; j < 3; j++)
+            meshlet->radius = fmaxf(meshlet->radius, vec3_length(vec3_sub(vertices[corners[j]].position, meshlet->center)));
+    }
+
+    meshlet->cone_axis = normal_sum;
+    meshlet->cone_cos = 0;
+    meshlet->cone_sin = 1;
+    if (vec3_length(normal_sum) == 0)
+        return;
+    vec3_normalize(&meshlet->cone_axis);
+
+    float cone_cos = 1;
+    meshlet->plane_offset_min = INFINITY;
+    meshlet->plane_offset_max = -INFINITY;
+    for (int i = meshlet->first_face; i < meshlet->first_face + meshlet->num_faces; i++)
+    {
+        vec3_t normal = get_face_normal(&faces[i], vertices);
+        if (vec3_length(normal) == 0)
+            continue;
+        float offset = vec3_dot(normal, vec3_sub(vertices[faces[i].a].position, meshlet->center));
+        cone_cos = fminf(cone_cos, vec3_dot(normal, meshlet->cone_axis));
+        meshlet->plane_offset_min = fminf(meshlet->plane_offset_min, offset);
+        meshlet->plane_offset_max = fmaxf(meshlet->plane_offset_max, offset);
+    }
+    meshlet->cone_cos = cone_cos;
+    meshlet->cone_sin = sqrtf(fmaxf(0, 1 - cone_cos * cone_cos));
+}
+
+////////////////////////////////////////////////////////////////////
+// Uniform grid over the face centroids, so the faces near a cluster
+// can be found without looking at the whole mesh. The faces of cell i
+// are cell_faces[cell_start[i]] up to cell_faces[cell_start[i + 1]].
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    vec3_t min;
+    float cell_size;
+    int dims[3];
+    int *cell_start;
+    int *cell_faces;
+} face_grid_t;
+
+static int get_grid_coordinate(const face_grid_t *grid, float value, float min, int axis)
+{
+    int coordinate = (int)((value - min) / grid->cell_size);
+    return coordinate < 0 ? 0 : (coordinate >= grid->dims[axis] ? grid->dims[axis] - 1 : coordinate);
+}
+
+static int get_grid_cell(const face_grid_t *grid, vec3_t p)
+{
+    int x = get_grid_coordinate(grid, p.x, grid->min.x, 0);
+    int y = get_grid_coordinate(grid, p.y, grid->min.y, 1);
+    int z = get_grid_coordinate(grid, p.z, grid->min.z, 2);
+    return (z * grid->dims[1] + y) * grid->dims[0] + x;
+}
+
+static void build_face_grid(face_grid_t *grid, const vec3_t *centroids, int num_faces)
+{
+    vec3_t min = centroids[0];
+    vec3_t max = min;
+    for (int i = 1; i < num_faces; i++)
+    {
+        min = vec3_new(fminf(min.x, centroids[i].x), fminf(min.y, centroids[i].y), fminf(min.z, centroids[i].z));
+        max = vec3_new(fmaxf(max.x, centroids[i].x), fmaxf(max.y, centroids[i].y), fmaxf(max.z, centroids[i].z));
+    }
+
+    // Cubic cells, as many along the longest axis as the cube root of the cell count
+    vec3_t size = vec3_sub(max, min);
+    float longest = fmaxf(size.x, fmaxf(size.y, size.z));
+    int cells_along_longest = (int)ceilf(cbrtf((float)num_faces / MESHLET_GRID_CELL_FACES));
+    grid->min = min;
+    grid->cell_size = longest > 0 ? longest / cells_along_longest : 1;
+    float sizes[3] = {size.x, size.y, size.z};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        grid->dims[axis] = (int)(sizes[axis] / grid->cell_size) + 1;
+        if (grid->dims[axis] > cells_along_longest)
+            grid->dims[axis] = cells_along_longest;
+    }
+
+    // Count the faces of each cell, then place them with a prefix sum
+    int num_cells = grid->dims[0] * grid->dims[1] * grid->dims[2];
+    grid->cell_start = (int *)calloc(num_cells + 1, sizeof(int));
+    grid->cell_faces = (int *)malloc(sizeof(int) * num_faces);
+    for (int i = 0; i < num_faces; i++)
+        grid->cell_start[get_grid_cell(grid, centroids[i]) + 1]++;
+    for (int c = 0; c < num_cells; c++)
+        grid->cell_start[c + 1] += grid->cell_start[c];
+    int *fill = (int *)malloc(sizeof(int) * num_cells);
+    memcpy(fill, grid->cell_start, sizeof(int) * num_cells);
+    for (int i = 0; i < num_faces; i++)
+        grid->cell_faces[fill[get_grid_cell(grid, centroids[i])]++] = i;
+    free(fill);
+}
+
+static void free_face_grid(face_grid_t *grid)
+{
+    free(grid->cell_start);
+    free(grid->cell_faces);
+}
+
+// Replace candidates with the free faces in the cells touching the sphere
+static void find_free_faces_near(int **candidates, const face_grid_t *grid, const bool *assigned, vec3_t center, float radius)
+{
+    array_clear(*candidates);
+    int x0 = get_grid_coordinate(grid, center.x - radius, grid->min.x, 0), x1 = get_grid_coordinate(grid, center.x + radius, grid->min.x, 0);
+    int y0 = get_grid_coordinate(grid, center.y - radius, grid->min.y, 1), y1 = get_grid_coordinate(grid, center.y + radius, grid->min.y, 1);
+    int z0 = get_grid_coordinate(grid, center.z - radius, grid->min.z, 2), z1 = get_grid_coordinate(grid, center.z + radius, grid->min.z, 2);
+    for (int z = z0; z <= z1; z++)
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                int cell = (z * grid->dims[1] + y) * grid->dims[0] + x;
+                for (int k = grid->cell_start[cell]; k < grid->cell_start[cell + 1]; k++)
+                {
+                    if (!assigned[grid->cell_faces[k]])
+                        array_push(*candidates, grid->cell_faces[k]);
+                }
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Among the candidates no farther than max_distance, the free face
+// whose normal is closest to the cluster axis, nearer faces winning
+// ties. Faces turned too far from the axis would widen the normal
+// cone and are never taken.
+////////////////////////////////////////////////////////////////////
+static int pick_next_face(const int *candidates, int num_candidates, const bool *assigned, const vec3_t *normals,
+                          const vec3_t *centroids, vec3_t axis, vec3_t center, float extent, float max_distance)
+{
+    float best_score = -INFINITY;
+    int best_face = -1;
+    for (int k = 0; k < num_candidates; k++)
+    {
+        int candidate = candidates[k];
+        if (assigned[candidate] || vec3_dot(normals[candidate], axis) < MESHLET_MIN_NORMAL_ALIGNMENT)
+            continue;
+
+        float distance = vec3_length(vec3_sub(centroids[candidate], center));
+        if (distance > max_distance)
+            continue;
+        float score = vec3_dot(normals[candidate], axis) - MESHLET_DISTANCE_WEIGHT * distance / fmaxf(extent, 1e-6f);
+        if (score > best_score)
+        {
+            best_score = score;
+            best_face = candidate;
+        }
+    }
+    return best_face;
+}
+
+////////////////////////////////////////////////////////////////////
+// Clusters grow greedily over faces sharing a vertex, taking the
+// candidate whose normal is closest to the cluster normal and which
+// lies nearest to the cluster, so both the cone and the sphere stay
+// tight. When no neighbour is left (a UV seam splits the vertices,
+// or the surface ends) the nearest free face continues the cluster.
+// The frontier lists each neighbour once, and the faces to jump to
+// are looked up in a grid, so building stays close to linear.
+////////////////////////////////////////////////////////////////////
+meshlet_t *build_meshlets(face_t *faces, const vertex_t *vertices, int num_vertices)
+{
+    int num_faces = array_length(faces);
+
+    TRACE_BEGIN("build_meshlets");
+    int **vertex_faces = (int **)calloc(num_vertices, sizeof(int *));
+    vec3_t *normals = (vec3_t *)malloc(sizeof(vec3_t) * num_faces);
+    vec3_t *centroids = (vec3_t *)malloc(sizeof(vec3_t) * num_faces);
+    bool *assigned = (bool *)calloc(num_faces, sizeof(bool));
+    int *order = (int *)malloc(sizeof(int) * num_faces);
+    bool *in_frontier = (bool *)calloc(num_faces, sizeof(bool));
+    int *frontier = NULL;
+    int *nearby = NULL;
+    for (int i = 0; i < num_faces; i++)
+    {
+        array_push(vertex_faces[faces[i].a], i);
+        array_push(vertex_faces[faces[i].b], i);
+        array_push(vertex_faces[faces[i].c], i);
+        normals[i] = get_face_normal(&faces[i], vertices);
+        centroids[i] = get_face_centroid(&faces[i], vertices);
+    }
+
+    face_grid_t grid = {0};
+    if (num_faces > 0)
+        build_face_grid(&grid, centroids, num_faces);
+
+    meshlet_t *meshlets = NULL;
+    int num_ordered = 0;
+    int next_seed = 0;
+    while (num_ordered < num_faces)
+    {
+        while (assigned[next_seed])
+            next_seed++;
+
+        // Start next to the previous cluster when it left free neighbours, so
+        // consecutive clusters share vertices
+        int face = next_seed;
+        for (int k = 0; k < array_length(frontier); k++)
+        {
+            if (!assigned[frontier[k]])
+            {
+                face = frontier[k];
+                break;
+            }
+        }
+
+        int first = num_ordered;
+        vec3_t normal_sum = vec3_new(0, 0, 0);
+        vec3_t centroid_sum = vec3_new(0, 0, 0);
+        float extent = 0;
+        for (int k = 0; k < array_length(frontier); k++)
+            in_frontier[frontier[k]] = false;
+        array_clear(frontier);
+
+        while (face >= 0)
+        {
+            assigned[face] = true;
+            order[num_ordered++] = face;
+            normal_sum = vec3_add(normal_sum, normals[face]);
+            centroid_sum = vec3_add(centroid_sum, centroids[face]);
+            vec3_t center = vec3_div(centroid_sum, num_ordered - first);
+            int corners[3] = {faces[face].a, faces[face].b, faces[face].c};
+            for (int j = 0; j < 3; j++)
+                extent = fmaxf(extent, vec3_length(vec3_sub(vertices[corners[j]].position, center)));
+            if (num_ordered - first == MESHLET_MAX_FACES || num_ordered == num_faces)
+                break;
+
+            for (int j = 0; j < 3; j++)
+            {
+                for (int k = 0; k < array_length(vertex_faces[corners[j]]); k++)
+                {
+                    int neighbour = vertex_faces[corners[j]][k];
+                    if (!assigned[neighbour] && !in_frontier[neighbour])
+                    {
+                        in_frontier[neighbour] = true;
+                        array_push(frontier, neighbour);
+                    }
+                }
+            }
+
+            // Best scoring free face of the frontier
+            vec3_t axis = normal_sum;
+            if (vec3_length(axis) > 0)
+                vec3_normalize(&axis);
+            face = pick_next_face(frontier, array_length(frontier), assigned, normals, centroids, axis, center, extent, INFINITY);
+
+            // Continue with a free face near the cluster when no neighbour fits
+            if (face < 0)
+            {
+                float max_distance = MESHLET_MAX_JUMP * fmaxf(extent, 1e-6f);
+                find_free_faces_near(&nearby, &grid, assigned, center, max_distance);
+                face = pick_next_face(nearby, array_length(nearby), assigned, normals, centroids, axis, center, extent, max_distance);
+            }
+        }
+
+        meshlet_t meshlet = {.first_face = first, .num_faces = num_ordered - first};
+        array_push(meshlets, meshlet);
+    }
+
+    // Move the faces into cluster order
+    face_t *ordered = (face_t *)malloc(sizeof(face_t) * num_faces);
+    for (int i = 0; i < num_faces; i++)
+        ordered[i] = faces[order[i]];
+    memcpy(faces, ordered, sizeof(face_t) * num_faces);
+    for (int i = 0; i < array_length(meshlets); i++)
+        compute_meshlet_bounds(&meshlets[i], faces, vertices);
+
+    free(ordered);
+    free_face_grid(&grid);
+    array_free(frontier);
+    array_free(nearby);
+    for (int v = 0; v < num_vertices; v++)
+        array_free(vertex_faces[v]);
+    free(vertex_faces);
+    free(normals);
+    free(centroids);
+    free(assigned);
+    free(order);
+    free(in_frontier);
+    TRACE_END("build_meshlets");
+    return meshlets;
+}
+
+////////////////////////////////////////////////////////////////////
+// A face with normal n through corner p looks away when
+// n . (p - camera) > 0. Split at the sphere center c, that is
+// n . (p - c) + n . (c - camera). The first term is at least the
+// smallest plane offset of the cluster. For n within the cone, the
+// second is at least |v| cos(theta + alpha), where v = c - camera,
+// theta is the angle between v and the cone axis and alpha the cone
+// angle; once theta + alpha reaches pi the bound is -|v|. When the
+// sum of both bounds is positive every face is back facing. A
+// mirroring transform flips the normals and the offsets.
+////////////////////////////////////////////////////////////////////
+bool is_meshlet_backfacing(const meshlet_t *meshlet, vec3_t model_camera, float orientation)
+{
+    if (meshlet->cone_cos <= 0)
+        return false;
+
+    vec3_t view = vec3_sub(meshlet->center, model_camera);
+    float distance = vec3_length(view);
+    if (distance == 0)
+        return false;
+
+    float cos_theta = orientation * vec3_dot(view, meshlet->cone_axis) / distance;
+    float sin_theta = sqrtf(fmaxf(0, 1 - cos_theta * cos_theta));
+
+    // Past theta + alpha = pi some normal of the cone points straight at the camera
+    float cos_sum = cos_theta <= -meshlet->cone_cos ? -1 : cos_theta * meshlet->cone_cos - sin_theta * meshlet->cone_sin;
+    float plane_offset = orientation > 0 ? meshlet->plane_offset_min : -meshlet->plane_offset_max;
+    return distance * cos_sum + plane_offset > 0;
+}
+
+bool is_meshlet_outside_frustum(const meshlet_t *meshlet, mat4_t model_view_matrix, float scale)
+{
+    vec3_t center = vec3_from_vec4(mat4_mul_vec4(model_view_matrix, vec4_from_vec3(meshlet->center)));
+    float radius = meshlet->radius * scale;
+    for (int i = 0; i < NUM_PLANES; i++)
+    {
+        if (vec3_dot(frustum_planes[i].normal, vec3_sub(center, frustum_planes[i].point)) < -radius)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,44 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+#include "triangle.h"
+
+////////////////////////////////////////////////////////////////////
+// Meshlets are clusters of up to MESHLET_MAX_FACES neighbouring faces
+// stored as a contiguous range of a face list. Each one carries a
+// bounding sphere and a cone around the normals of its faces, so a
+// whole cluster can be rejected by the frustum or as back facing with
+// a single test before its faces are looked at.
+////////////////////////////////////////////////////////////////////
+#define MESHLET_MAX_FACES 64
+#define MESHLET_MIN_NORMAL_ALIGNMENT 0.7f // Smallest cosine between a face normal and the growing cluster normal
+#define MESHLET_DISTANCE_WEIGHT 0.5f      // Penalty of faces far from the cluster, relative to its extent
+#define MESHLET_MAX_JUMP 2.0f             // Farthest a cluster continues to a face it shares no vertex with, relative to its extent
+#define MESHLET_GRID_CELL_FACES 8         // Faces per cell of the grid searched for those faces, on average along the longest axis
+
+typedef struct
+{
+    int first_face;  // First face of the cluster in the face list of its level
+    int num_faces;
+    vec3_t center;   // Model space bounding sphere of the faces
+    float radius;
+    vec3_t cone_axis; // Unit vector all face normals are within the cone angle of
+    float cone_cos;   // Cosine of the cone angle, 0 or less when the cone cannot cull
+    float cone_sin;
+    float plane_offset_min; // Range of n . (p - center) over the faces, n their normal and p a corner
+    float plane_offset_max;
+} meshlet_t;
+
+// Reorder faces into clusters; returns a dynamic array of meshlets covering them in order
+meshlet_t *build_meshlets(face_t *faces, const vertex_t *vertices, int num_vertices);
+
+// True when every face of the cluster looks away from the model space camera position
+bool is_meshlet_backfacing(const meshlet_t *meshlet, vec3_t model_camera, float orientation);
+
+// True when the bounding sphere is outside one of the camera space frustum planes
+bool is_meshlet_outside_frustum(const meshlet_t *meshlet, mat4_t model_view_matrix, float scale);
+
+#endif
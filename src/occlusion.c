@@ -0,0 +1,317 @@
+#include <stdlib.h>
+#include <math.h>
+#include "occlusion.h"
+#include "array.h"
+#include "clipping.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "stats.h"
+#include "trace.h"
+#include "triangle.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef struct
+{
+    mesh_t *mesh;
+    mesh_instance_t *instance;
+    float distance; // View space depth of the bounds center
+} occluder_t;
+
+static bool occlusion_enabled = false;
+static float *occlusion_buffer = NULL;
+static float *filter_buffer = NULL;
+static occluder_t *occluders = NULL;
+static vec4_t *projected_vertices = NULL;
+
+void init_occlusion(bool enabled)
+{
+    occlusion_enabled = enabled;
+    occlusion_buffer = (float *)malloc(sizeof(float) * OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT);
+    filter_buffer = (float *)malloc(sizeof(float) * OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT);
+}
+
+void free_occlusion(void)
+{
+    free(occlusion_buffer);
+    free(filter_buffer);
+    array_free(occluders);
+    array_free(projected_vertices);
+    occlusion_buffer = NULL;
+    filter_buffer = NULL;
+    occluders = NULL;
+    projected_vertices = NULL;
+}
+
+void toggle_occlusion_culling(void)
+{
+    occlusion_enabled = !occlusion_enabled;
+}
+
+static float get_z_near(void)
+{
+    return frustum_planes[NEAR_FRUSTUM_PLANE].point.z;
+}
+
+// Same mapping from clip space to pixels as the geometry stage, at the occlusion buffer size
+static vec4_t project_to_occlusion_buffer(mat4_t proj_matrix, vec4_t point)
+{
+    vec4_t projected = mat4_mul_vec4_project(proj_matrix, point);
+    projected.x = (projected.x + 1) * (OCCLUSION_BUFFER_WIDTH / 2.0);
+    projected.y = (1 - projected.y) * (OCCLUSION_BUFFER_HEIGHT / 2.0);
+    return projected;
+}
+
+static int compare_occluder_distance(const void *a, const void *b)
+{
+    float distance_a = ((const occluder_t *)a)->distance;
+    float distance_b = ((const occluder_t *)b)->distance;
+    return (distance_a > distance_b) - (distance_a < distance_b);
+}
+
+////////////////////////////////////////////////////////////////////
+// Rasterize the front faces of an occluder. Faces crossing the near
+// plane are skipped instead of clipped: the buffer may only ever
+// claim less occlusion than there really is.
+////////////////////////////////////////////////////////////////////
+static void rasterize_occluder(const mesh_t *mesh, const mesh_instance_t *instance, mat4_t view_matrix, mat4_t proj_matrix)
+{
+    mat4_t model_view_matrix = mat4_mul_mat4(view_matrix, get_mesh_instance_world_matrix(instance));
+    float z_near = get_z_near();
+
+    // Transform and project every vertex once, faces share them
+    array_clear(projected_vertices);
+    if (mesh->quantized_vertices != NULL)
+    {
+        mat4_t vertex_matrix = mat4_mul_mat4(model_view_matrix, mesh->dequantize_matrix);
+        for (int i = 0; i < array_length(mesh->quantized_vertices); i++)
+        {
+            const uint16_t *position = mesh->quantized_vertices[i].position;
+            vec4_t camera_vertex = mat4_mul_vec4(vertex_matrix, vec4_from_vec3(vec3_new(position[0], position[1], position[2])));
+            array_push(projected_vertices, camera_vertex);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < array_length(mesh->vertices); i++)
+        {
+            vec4_t camera_vertex = mat4_mul_vec4(model_view_matrix, vec4_from_vec3(mesh->vertices[i].position));
+            array_push(projected_vertices, camera_vertex);
+        }
+    }
+
+    for (int i = 0; i < array_length(mesh->lods[0].faces); i++)
+    {
+        const face_t *face = &mesh->lods[0].faces[i];
+        vec4_t a = projected_vertices[face->a];
+        vec4_t b = projected_vertices[face->b];
+        vec4_t c = projected_vertices[face->c];
+        if (a.z < z_near || b.z < z_near || c.z < z_near)
+            continue;
+
+        // Same backface test as the geometry stage, in camera space
+        vec3_t normal = vec3_cross(vec3_sub(vec3_from_vec4(b), vec3_from_vec4(a)), vec3_sub(vec3_from_vec4(c), vec3_from_vec4(a)));
+        if (vec3_dot(normal, vec3_mul(vec3_from_vec4(a), -1)) < 0)
+            continue;
+
+        draw_depth_triangle(occlusion_buffer, OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT,
+                            project_to_occlusion_buffer(proj_matrix, a),
+                            project_to_occlusion_buffer(proj_matrix, b),
+                            project_to_occlusion_buffer(proj_matrix, c));
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Replace every pixel by the farthest depth of its 3x3 neighborhood.
+// Pixels are rasterized at their centers, so an occluder edge may
+// cover only part of a pixel it wrote; after the filter a pixel only
+// stays near if all its neighbors were covered as well, which makes
+// the buffer conservative along silhouettes. Pixels outside the
+// buffer count as empty.
+////////////////////////////////////////////////////////////////////
+static void filter_occlusion_buffer(void)
+{
+    const int width = OCCLUSION_BUFFER_WIDTH;
+    const int height = OCCLUSION_BUFFER_HEIGHT;
+
+    // Horizontal pass into the filter buffer, through a row padded with empty pixels
+    float padded_row[OCCLUSION_BUFFER_WIDTH + 2];
+    padded_row[0] = padded_row[width + 1] = 1.0f;
+    for (int y = 0; y < height; y++)
+    {
+        const float *src = &occlusion_buffer[y * width];
+        float *dst = &filter_buffer[y * width];
+        for (int x = 0; x < width; x++)
+            padded_row[x + 1] = src[x];
+
+        int x = 0;
+#if defined(__SSE2__)
+        for (; x < width; x += 4)
+        {
+            __m128 left = _mm_loadu_ps(&padded_row[x]);
+            __m128 center = _mm_loadu_ps(&padded_row[x + 1]);
+            __m128 right = _mm_loadu_ps(&padded_row[x + 2]);
+            _mm_storeu_ps(&dst[x], _mm_max_ps(_mm_max_ps(left, center), right));
+        }
+#endif
+        for (; x < width; x++)
+            dst[x] = fmaxf(fmaxf(padded_row[x], padded_row[x + 1]), padded_row[x + 2]);
+    }
+
+    // Vertical pass back into the occlusion buffer
+    for (int y = 0; y < height; y++)
+    {
+        float *dst = &occlusion_buffer[y * width];
+        if (y == 0 || y == height - 1)
+        {
+            for (int x = 0; x < width; x++)
+                dst[x] = 1.0f;
+            continue;
+        }
+
+        const float *above = &filter_buffer[(y - 1) * width];
+        const float *row = &filter_buffer[y * width];
+        const float *below = &filter_buffer[(y + 1) * width];
+        int x = 0;
+#if defined(__SSE2__)
+        for (; x < width; x += 4)
+        {
+            __m128 farthest = _mm_max_ps(_mm_max_ps(_mm_loadu_ps(&above[x]), _mm_loadu_ps(&row[x])), _mm_loadu_ps(&below[x]));
+            _mm_storeu_ps(&dst[x], farthest);
+        }
+#endif
+        for (; x < width; x++)
+            dst[x] = fmaxf(fmaxf(above[x], row[x]), below[x]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// An instance is hidden when every pixel overlapped by the screen
+// rectangle of its bounds holds an occluder closer than the nearest
+// corner of those bounds.
+////////////////////////////////////////////////////////////////////
+static bool is_instance_occluded(const mesh_t *mesh, const mesh_instance_t *instance, mat4_t view_matrix, mat4_t proj_matrix)
+{
+    aabb_t bounds = get_mesh_instance_bounds(mesh, instance);
+    float z_near = get_z_near();
+
+    float min_x = OCCLUSION_BUFFER_WIDTH, max_x = 0;
+    float min_y = OCCLUSION_BUFFER_HEIGHT, max_y = 0;
+    float min_w = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        vec3_t corner = vec3_new(
+            (i & 1) ? bounds.max.x : bounds.min.x,
+            (i & 2) ? bounds.max.y : bounds.min.y,
+            (i & 4) ? bounds.max.z : bounds.min.z);
+        vec4_t camera_corner = mat4_mul_vec4(view_matrix, vec4_from_vec3(corner));
+
+        // Bounds reaching behind the near plane have no meaningful screen rectangle
+        if (camera_corner.z < z_near)
+            return false;
+
+        vec4_t projected = project_to_occlusion_buffer(proj_matrix, camera_corner);
+        min_x = fminf(min_x, projected.x);
+        max_x = fmaxf(max_x, projected.x);
+        min_y = fminf(min_y, projected.y);
+        max_y = fmaxf(max_y, projected.y);
+        min_w = (i == 0) ? projected.w : fminf(min_w, projected.w);
+    }
+
+    int x0 = (int)floorf(min_x);
+    int x1 = (int)ceilf(max_x) - 1;
+    int y0 = (int)floorf(min_y);
+    int y1 = (int)ceilf(max_y) - 1;
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > OCCLUSION_BUFFER_WIDTH - 1 ? OCCLUSION_BUFFER_WIDTH - 1 : x1;
+    y1 = y1 > OCCLUSION_BUFFER_HEIGHT - 1 ? OCCLUSION_BUFFER_HEIGHT - 1 : y1;
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    float nearest_depth = 1 - 1 / min_w;
+    for (int y = y0; y <= y1; y++)
+    {
+        const float *row = &occlusion_buffer[y * OCCLUSION_BUFFER_WIDTH];
+        int x = x0;
+#if defined(__SSE2__)
+        __m128 nearest = _mm_set1_ps(nearest_depth);
+        for (; x + 3 <= x1; x += 4)
+        {
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(&row[x]), nearest)) != 0)
+                return false;
+        }
+#endif
+        for (; x <= x1; x++)
+        {
+            if (row[x] >= nearest_depth)
+                return false;
+        }
+    }
+    return true;
+}
+
+void cull_occluded_instances(mat4_t view_matrix, mat4_t proj_matrix)
+{
+    if (!occlusion_enabled)
+        return;
+
+    uint64_t occlusion_start = profile_begin();
+    TRACE_BEGIN("occlusion");
+
+    // Pick the visible occluders nearest to the camera
+    array_clear(occluders);
+    for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++)
+    {
+        // A placeholder box is larger than the mesh it stands for and would hide too much
+        mesh_t *mesh = get_mesh(mesh_index);
+        if (!mesh->is_occluder || mesh->is_placeholder)
+            continue;
+
+        vec3_t center = vec3_mul(vec3_add(mesh->bounds.min, mesh->bounds.max), 0.5);
+        for (int i = 0; i < array_length(mesh->instances); i++)
+        {
+            mesh_instance_t *instance = &mesh->instances[i];
+            if (!instance->visible)
+                continue;
+
+            mat4_t model_view_matrix = mat4_mul_mat4(view_matrix, get_mesh_instance_world_matrix(instance));
+            occluder_t occluder = {
+                .mesh = mesh,
+                .instance = instance,
+                .distance = mat4_mul_vec4(model_view_matrix, vec4_from_vec3(center)).z};
+            array_push(occluders, occluder);
+        }
+    }
+
+    // Without occluders every test would fail, skip the whole pass
+    if (array_length(occluders) > 0)
+    {
+        qsort(occluders, array_length(occluders), sizeof(occluder_t), compare_occluder_distance);
+
+        for (int i = 0; i < OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT; i++)
+            occlusion_buffer[i] = 1.0f;
+        for (int i = 0; i < array_length(occluders) && i < OCCLUSION_MAX_OCCLUDERS; i++)
+            rasterize_occluder(occluders[i].mesh, occluders[i].instance, view_matrix, proj_matrix);
+        filter_occlusion_buffer();
+
+        for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++)
+        {
+            mesh_t *mesh = get_mesh(mesh_index);
+            for (int i = 0; i < array_length(mesh->instances); i++)
+            {
+                mesh_instance_t *instance = &mesh->instances[i];
+                if (instance->visible && is_instance_occluded(mesh, instance, view_matrix, proj_matrix))
+                {
+                    instance->visible = false;
+                    frame_stats.instances_occlusion_culled++;
+                }
+            }
+        }
+    }
+
+    TRACE_END("occlusion");
+    profile_end(PROFILE_OCCLUSION, occlusion_start);
+}
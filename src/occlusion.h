@@ -0,0 +1,25 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stdbool.h>
+#include "matrix.h"
+
+////////////////////////////////////////////////////////////////////
+// Software occlusion culling. The nearest visible occluder meshes are
+// rasterized depth-only into a small buffer, then the screen space
+// bounds of every other visible instance are tested against it and
+// fully hidden instances skip the geometry stage.
+////////////////////////////////////////////////////////////////////
+#define OCCLUSION_BUFFER_WIDTH 256
+#define OCCLUSION_BUFFER_HEIGHT 128
+#define OCCLUSION_MAX_OCCLUDERS 32
+
+void init_occlusion(bool enabled);
+void free_occlusion(void);
+
+void toggle_occlusion_culling(void);
+
+// Clear the visible flag of instances hidden behind occluders
+void cull_occluded_instances(mat4_t view_matrix, mat4_t proj_matrix);
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "trace.h"
+#include "golden.h"
+#include "scene.h"
+#include "meshcache.h"
+
+static options_t options = {
+    .scene_file = NULL,
+    .headless = false,
+    .width = 800,
+    .height = 600,
+    .max_frames = 0,
+    .frame_output = NULL,
+    .render_method = 0,
+    .bench = false,
+    .uncapped = false,
+    .no_occlusion = false,
+    .no_lod = false,
+    .cache_dir = DEFAULT_CACHE_DIR,
+    .no_reorder = false,
+    .quantize_vertices = false,
+    .compress_textures = false,
+    .texture_atlas = false,
+    .stream = true,
+    .mesh_report = false,
+    .asset_report = false,
+    .bench_csv = NULL,
+    .profile_hud = false,
+    .profile_csv = NULL,
+    .trace_file = NULL,
+    .trace_frames = TRACE_DEFAULT_FRAMES,
+    .golden_dir = NULL,
+    .golden_update = false,
+    .golden_tolerance = GOLDEN_DEFAULT_TOLERANCE};
+
+const options_t *get_options(void)
+{
+    return &options;
+}
+
+void print_usage(const char *program_name)
+{
+    printf("Usage: %s [options]\n", program_name);
+    printf("  --scene FILE       load the scene description FILE (default: %s)\n", DEFAULT_SCENE_FILE);
+    printf("  --headless WxH     render offscreen at a fixed resolution (no SDL window)\n");
+    printf("  --frames N         exit after rendering N frames (headless default: 1)\n");
+    printf("  --output PATTERN   dump each frame, e.g. frame_%%04d.png or frame_%%04d.ppm\n");
+    printf("  --render-method N  start in render method N (same numbers as keys 1-7, 7 = overdraw)\n");
+    printf("  --bench [N]        fly the scripted benchmark path for N frames (default: 600)\n");
+    printf("  --bench-csv FILE   append benchmark results to FILE instead of printing them\n");
+    printf("  --uncapped         disable the FPS frame cap\n");
+    printf("  --no-occlusion     start with occlusion culling disabled (toggle with O)\n");
+    printf("  --no-lod           start with levels of detail disabled (toggle with L)\n");
+    printf("  --cache-dir DIR    keep processed meshes and decoded textures in DIR (default: %s)\n", DEFAULT_CACHE_DIR);
+    printf("  --no-cache         always load meshes and textures from their source files\n");
+    printf("  --no-reorder       keep mesh faces and vertices in file order (no vertex cache optimization)\n");
+    printf("  --quantize         store mesh vertices quantized to 16 bits (positions and uvs)\n");
+    printf("  --compress-textures  store textures BC1 compressed (4 bits per texel), decoded by the sampler\n");
+    printf("  --atlas            pack the scene textures into shared atlas pages once loaded\n");
+    printf("  --stream           load scene meshes in the background (default without --headless)\n");
+    printf("  --no-stream        load every scene mesh before the first frame (default with --headless)\n");
+    printf("  --mesh-report      print vertex, face and vertex cache figures of every loaded mesh\n");
+    printf("  --asset-report     print the references, memory and load time of every loaded file\n");
+    printf("  --profile          show the per-stage profiler overlay (toggle with P)\n");
+    printf("  --profile-csv FILE stream per-frame stage timings to FILE\n");
+    printf("  --trace FILE       capture a Chrome trace (JSON) from startup to FILE (T key: trace.json)\n");
+    printf("  --trace-frames N   number of frames covered by a trace capture (default: %d)\n", TRACE_DEFAULT_FRAMES);
+    printf("  --golden DIR       render the golden-image test cases and compare them with DIR\n");
+    printf("  --golden-update    write the golden references to DIR instead of comparing\n");
+    printf("  --golden-tolerance N  per-channel difference accepted as a match (default: %d)\n", GOLDEN_DEFAULT_TOLERANCE);
+    printf("  --help             show this message\n");
+}
+
+static bool parse_resolution(const char *text, int *width, int *height)
+{
+    return sscanf(text, "%dx%d", width, height) == 2 && *width > 0 && *height > 0;
+}
+
+////////////////////////////////////////////////////////////////////
+// The frame output pattern is handed to snprintf with the frame index,
+// so it may hold at most one conversion and it has to be an integer
+// one (flags, width and precision allowed); %% stands for itself.
+////////////////////////////////////////////////////////////////////
+static bool is_valid_output_pattern(const char *pattern)
+{
+    int num_conversions = 0;
+    for (const char *c = pattern; *c != '\0'; c++)
+    {
+        if (*c != '%')
+            continue;
+        if (*++c == '%')
+            continue;
+
+        c += strspn(c, "-+ #0");
+        c += strspn(c, "0123456789");
+        if (*c == '.')
+        {
+            c++;
+            c += strspn(c, "0123456789");
+        }
+        if ((*c != 'd' && *c != 'i') || ++num_conversions > 1)
+            return false;
+    }
+    return true;
+}
+
+bool parse_options(int argc, char *argv[])
+{
+    bool stream_set = false;
+    for (int i = 1; i < argc; i++)
+    {
+        // Options that take a value must have one following them
+        bool has_value = (i + 1 < argc);
+
+        if (strcmp(argv[i], "--scene") == 0 && has_value)
+        {
+            options.scene_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--headless") == 0 && has_value)
+        {
+            if (!parse_resolution(argv[++i], &options.width, &options.height))
+            {
+                fprintf(stderr, "Invalid resolution '%s', expected WxH.\n", argv[i]);
+                return false;
+            }
+            options.headless = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && has_value)
+        {
+            options.max_frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--output") == 0 && has_value)
+        {
+            options.frame_output = argv[++i];
+            if (!is_valid_output_pattern(options.frame_output))
+            {
+                fprintf(stderr, "Invalid output pattern '%s', expected at most one %%d (e.g. frame_%%04d.png).\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--render-method") == 0 && has_value)
+        {
+            options.render_method = atoi(argv[++i]);
+            if (options.render_method < 1 || options.render_method > 7)
+            {
+                fprintf(stderr, "Invalid render method '%s', expected 1-7.\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            options.bench = true;
+            options.uncapped = true;
+            if (has_value && argv[i + 1][0] != '-')
+                options.max_frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench-csv") == 0 && has_value)
+        {
+            options.bench_csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            options.profile_hud = true;
+        }
+        else if (strcmp(argv[i], "--profile-csv") == 0 && has_value)
+        {
+            options.profile_csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && has_value)
+        {
+            options.trace_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace-frames") == 0 && has_value)
+        {
+            options.trace_frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--golden") == 0 && has_value)
+        {
+            options.golden_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--golden-update") == 0)
+        {
+            options.golden_update = true;
+        }
+        else if (strcmp(argv[i], "--golden-tolerance") == 0 && has_value)
+        {
+            options.golden_tolerance = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-occlusion") == 0)
+        {
+            options.no_occlusion = true;
+        }
+        else if (strcmp(argv[i], "--no-lod") == 0)
+        {
+            options.no_lod = true;
+        }
+        else if (strcmp(argv[i], "--cache-dir") == 0 && has_value)
+        {
+            options.cache_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-cache") == 0)
+        {
+            options.cache_dir = NULL;
+        }
+        else if (strcmp(argv[i], "--no-reorder") == 0)
+        {
+            options.no_reorder = true;
+        }
+        else if (strcmp(argv[i], "--quantize") == 0)
+        {
+            options.quantize_vertices = true;
+        }
+        else if (strcmp(argv[i], "--compress-textures") == 0)
+        {
+            options.compress_textures = true;
+        }
+        else if (strcmp(argv[i], "--atlas") == 0)
+        {
+            options.texture_atlas = true;
+        }
+        else if (strcmp(argv[i], "--stream") == 0 || strcmp(argv[i], "--no-stream") == 0)
+        {
+            options.stream = strcmp(argv[i], "--stream") == 0;
+            stream_set = true;
+        }
+        else if (strcmp(argv[i], "--mesh-report") == 0)
+        {
+            options.mesh_report = true;
+        }
+        else if (strcmp(argv[i], "--asset-report") == 0)
+        {
+            options.asset_report = true;
+        }
+        else if (strcmp(argv[i], "--uncapped") == 0)
+        {
+            options.uncapped = true;
+        }
+        else
+        {
+            if (strcmp(argv[i], "--help") != 0)
+                fprintf(stderr, "Unknown or incomplete option '%s'.\n", argv[i]);
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    // Golden images are always rendered offscreen, as fast as possible and at full precision and detail;
+    // the harness turns quantization, compression and the atlas back on for its variant passes
+    if (options.golden_dir != NULL)
+    {
+        options.no_lod = true;
+        options.quantize_vertices = false;
+        options.compress_textures = false;
+        options.texture_atlas = false;
+        options.stream = false;
+        if (!options.headless)
+        {
+            options.width = 160;
+            options.height = 120;
+        }
+        options.headless = true;
+        options.uncapped = true;
+    }
+
+    // The benchmark needs a bounded run to compute its percentiles
+    if (options.bench && options.max_frames == 0)
+        options.max_frames = 600;
+
+    // Offscreen frames and benchmark runs must show the whole scene from the first frame
+    if (!stream_set)
+        options.stream = !options.headless && !options.bench;
+
+    // A headless run without an explicit frame count renders a single frame
+    if (options.headless && options.max_frames == 0)
+        options.max_frames = 1;
+
+    return true;
+}
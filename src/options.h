@@ -0,0 +1,46 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Command line options of the renderer
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    char *scene_file;   // Scene description to load, NULL picks the default (or benchmark) scene
+    bool headless;      // Render offscreen without opening an SDL window
+    int width;          // Framebuffer width used by the headless backend
+    int height;         // Framebuffer height used by the headless backend
+    int max_frames;     // Number of frames to render before exiting (0 = run until quit)
+    char *frame_output; // printf-style path of dumped frames (.ppm or .png), NULL discards them
+    int render_method;  // Initial render method as numbered on the keyboard (1-7), 0 keeps the default
+    bool bench;         // Run the deterministic benchmark instead of the interactive scene
+    bool uncapped;      // Disable the FPS cap (always on when benchmarking)
+    bool no_occlusion;  // Start with occlusion culling disabled
+    bool no_lod;        // Start with every instance drawn at full detail
+    char *cache_dir;    // Directory of processed mesh and decoded texture files, NULL disables the caches
+    bool no_reorder;    // Keep faces and vertices in file order instead of optimizing them for the vertex cache
+    bool quantize_vertices; // Store mesh vertices compressed to 16-bit fractions of the mesh bounds
+    bool compress_textures; // Store textures as BC1 blocks decoded by the sampler
+    bool texture_atlas; // Pack the scene textures into shared pages once they are all loaded
+    bool stream;        // Load scene meshes on a background thread while frames are rendered
+    bool mesh_report;   // Print the load time processing figures of every mesh
+    bool asset_report;  // Print the memory and load time of every loaded file
+    char *bench_csv;    // CSV file the benchmark results are appended to, NULL prints to stdout
+    bool profile_hud;   // Show the per-stage profiler overlay from the first frame
+    char *profile_csv;  // CSV file per-frame stage timings are streamed to, NULL disables it
+    char *trace_file;   // Chrome trace JSON captured from startup, NULL waits for the T key
+    int trace_frames;   // Number of frames covered by a trace capture
+    char *golden_dir;   // Directory of golden reference images, NULL runs the renderer normally
+    bool golden_update; // Write new reference images instead of comparing against them
+    int golden_tolerance; // Largest per-channel difference still counted as a match
+} options_t;
+
+bool parse_options(int argc, char *argv[]);
+
+const options_t *get_options(void);
+
+void print_usage(const char *program_name);
+
+#endif
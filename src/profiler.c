@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include "profiler.h"
+#include "timer.h"
+#include "display.h"
+#include "font.h"
+
+static bool profiler_enabled = false;
+static bool hud_visible = false;
+static FILE *csv_file = NULL;
+
+typedef struct
+{
+    uint64_t stage_ns[NUM_PROFILE_STAGES];
+    uint32_t stage_calls[NUM_PROFILE_STAGES];
+    uint64_t frame_ns;
+} profile_frame_t;
+
+static profile_frame_t current_frame;
+static profile_frame_t last_frame;
+static uint64_t frame_start_ns = 0;
+static uint64_t frame_number = 0;
+
+static const char *stage_names[NUM_PROFILE_STAGES] = {
+    "bvh_build",
+    "bvh_refit",
+    "cull",
+    "occlusion",
+    "geometry",
+    "clipping",
+    "raster",
+    "clear",
+    "present"};
+
+void init_profiler(bool show_hud, const char *csv_filename)
+{
+    hud_visible = show_hud;
+
+    if (csv_filename != NULL)
+    {
+        csv_file = fopen(csv_filename, "w");
+        if (csv_file == NULL)
+        {
+            fprintf(stderr, "Error opening %s for writing.\n", csv_filename);
+        }
+        else
+        {
+            fprintf(csv_file, "frame,frame_ms");
+            for (int i = 0; i < NUM_PROFILE_STAGES; i++)
+                fprintf(csv_file, ",%s_ms,%s_calls", stage_names[i], stage_names[i]);
+            fprintf(csv_file, "\n");
+        }
+    }
+
+    profiler_enabled = hud_visible || csv_file != NULL;
+}
+
+void free_profiler(void)
+{
+    if (csv_file != NULL)
+    {
+        fclose(csv_file);
+        csv_file = NULL;
+    }
+}
+
+void toggle_profiler_hud(void)
+{
+    hud_visible = !hud_visible;
+    profiler_enabled = hud_visible || csv_file != NULL;
+}
+
+uint64_t profile_begin(void)
+{
+    return profiler_enabled ? get_time_ns() : 0;
+}
+
+void profile_end(int stage, uint64_t start_ns)
+{
+    if (start_ns == 0)
+        return;
+
+    current_frame.stage_ns[stage] += get_time_ns() - start_ns;
+    current_frame.stage_calls[stage]++;
+}
+
+void profiler_begin_frame(void)
+{
+    memset(&current_frame, 0, sizeof(current_frame));
+    frame_start_ns = profile_begin();
+}
+
+void profiler_end_frame(void)
+{
+    if (frame_start_ns == 0)
+        return;
+
+    current_frame.frame_ns = get_time_ns() - frame_start_ns;
+    last_frame = current_frame;
+
+    if (csv_file != NULL)
+    {
+        fprintf(csv_file, "%llu,%.4f", (unsigned long long)frame_number, last_frame.frame_ns / 1e6);
+        for (int i = 0; i < NUM_PROFILE_STAGES; i++)
+            fprintf(csv_file, ",%.4f,%u", last_frame.stage_ns[i] / 1e6, last_frame.stage_calls[i]);
+        fprintf(csv_file, "\n");
+    }
+    frame_number++;
+}
+
+void draw_profiler_hud(void)
+{
+    if (!hud_visible)
+        return;
+
+    // Scale the font up on big framebuffers so it stays readable
+    int scale = (get_window_height() >= 1000) ? 2 : 1;
+    int line_height = (FONT_GLYPH_HEIGHT + 3) * scale;
+    int x = 8 * scale;
+    int y = 8 * scale;
+
+    draw_rect(x - 4 * scale, y - 4 * scale, 34 * FONT_GLYPH_ADVANCE * scale, (NUM_PROFILE_STAGES + 1) * line_height + 6 * scale, 0xFF000000);
+
+    char line[64];
+    snprintf(line, sizeof(line), "frame     %8.3f ms", last_frame.frame_ns / 1e6);
+    draw_text(x, y, line, 0xFFFFFFFF, scale);
+
+    for (int i = 0; i < NUM_PROFILE_STAGES; i++)
+    {
+        y += line_height;
+        snprintf(line, sizeof(line), "%-9s %8.3f ms %7u", stage_names[i], last_frame.stage_ns[i] / 1e6, last_frame.stage_calls[i]);
+        draw_text(x, y, line, 0xFF00FF00, scale);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Pipeline stages measured by the profiler. Timings are inclusive,
+// so clipping time is also part of the geometry stage time.
+////////////////////////////////////////////////////////////////////
+enum profile_stage
+{
+    PROFILE_BVH_BUILD, // rebuild of the scene BVH after instances were added or removed
+    PROFILE_BVH_REFIT, // refit of the scene BVH after instances moved
+    PROFILE_CULL,      // frustum culling of instances against the scene BVH
+    PROFILE_OCCLUSION, // occluder rasterization and occlusion tests
+    PROFILE_GEOMETRY,  // process_graphic_pipeline_stages()
+    PROFILE_CLIPPING,  // clip_polygon()
+    PROFILE_RASTER,    // draw_filled_triangle() and draw_textured_triangle()
+    PROFILE_CLEAR,     // clear_color_buffer() and clear_z_buffer()
+    PROFILE_PRESENT,   // render_color_buffer()
+    NUM_PROFILE_STAGES
+};
+
+void init_profiler(bool show_hud, const char *csv_filename);
+void free_profiler(void);
+
+void toggle_profiler_hud(void);
+
+////////////////////////////////////////////////////////////////////
+// Scoped timer: keep the value returned by profile_begin() and hand it
+// back to profile_end() when the stage finishes. Both are no-ops while
+// the profiler is disabled.
+////////////////////////////////////////////////////////////////////
+uint64_t profile_begin(void);
+void profile_end(int stage, uint64_t start_ns);
+
+void profiler_begin_frame(void);
+void profiler_end_frame(void);
+
+// Draw the last frame results as a text overlay into the color buffer
+void draw_profiler_hud(void);
+
+#endif
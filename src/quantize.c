@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <math.h>
+#include "quantize.h"
+#include "array.h"
+#include "trace.h"
+
+static bool quantization_enabled = false;
+
+void init_vertex_quantization(bool enabled)
+{
+    quantization_enabled = enabled;
+}
+
+bool is_vertex_quantization_enabled(void)
+{
+    return quantization_enabled;
+}
+
+// Fraction of the way from offset, in steps of size step
+static uint16_t quantize_unorm(float value, float offset, float step)
+{
+    if (step <= 0)
+        return 0;
+    float quantized = roundf((value - offset) / step);
+    return (uint16_t)fminf(fmaxf(quantized, 0), QUANTIZE_UNORM_MAX);
+}
+
+void quantize_mesh_vertices(mesh_t *mesh)
+{
+    int num_vertices = array_length(mesh->vertices);
+    if (num_vertices == 0)
+        return;
+
+    TRACE_BEGIN("quantize_vertices");
+    vec3_t extent = vec3_sub(mesh->bounds.max, mesh->bounds.min);
+    vec3_t step = vec3_div(extent, QUANTIZE_UNORM_MAX);
+    mesh->dequantize_matrix = mat4_mul_mat4(
+        mat4_make_translation(mesh->bounds.min.x, mesh->bounds.min.y, mesh->bounds.min.z),
+        mat4_make_scale(step.x, step.y, step.z));
+
+    tex2_t uv_min = mesh->vertices[0].uv;
+    tex2_t uv_max = uv_min;
+    for (int i = 1; i < num_vertices; i++)
+    {
+        uv_min.u = fminf(uv_min.u, mesh->vertices[i].uv.u);
+        uv_min.v = fminf(uv_min.v, mesh->vertices[i].uv.v);
+        uv_max.u = fmaxf(uv_max.u, mesh->vertices[i].uv.u);
+        uv_max.v = fmaxf(uv_max.v, mesh->vertices[i].uv.v);
+    }
+    mesh->uv_offset = uv_min;
+    mesh->uv_step.u = (uv_max.u - uv_min.u) / QUANTIZE_UNORM_MAX;
+    mesh->uv_step.v = (uv_max.v - uv_min.v) / QUANTIZE_UNORM_MAX;
+
+    float position_error = 0;
+    for (int i = 0; i < num_vertices; i++)
+    {
+        const vertex_t *vertex = &mesh->vertices[i];
+        quantized_vertex_t quantized = {
+            .position = {
+                quantize_unorm(vertex->position.x, mesh->bounds.min.x, step.x),
+                quantize_unorm(vertex->position.y, mesh->bounds.min.y, step.y),
+                quantize_unorm(vertex->position.z, mesh->bounds.min.z, step.z)},
+            .uv = {
+                quantize_unorm(vertex->uv.u, uv_min.u, mesh->uv_step.u),
+                quantize_unorm(vertex->uv.v, uv_min.v, mesh->uv_step.v)}};
+        array_push(mesh->quantized_vertices, quantized);
+
+        vec3_t stored = vec3_new(quantized.position[0], quantized.position[1], quantized.position[2]);
+        vec4_t position = mat4_mul_vec4(mesh->dequantize_matrix, vec4_from_vec3(stored));
+        position_error = fmaxf(position_error, vec3_length(vec3_sub(vec3_from_vec4(position), vertex->position)));
+    }
+    mesh->report.position_error = position_error;
+
+    array_free(mesh->vertices);
+    mesh->vertices = NULL;
+    TRACE_END("quantize_vertices");
+}
@@ -0,0 +1,26 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stdbool.h>
+#include "mesh.h"
+
+////////////////////////////////////////////////////////////////////
+// Optional compressed vertex storage. Positions are stored as 16-bit
+// fractions of the mesh bounds and uvs as 16-bit fractions of the uv
+// range of the mesh. Normals are not kept, as nothing reads them from
+// a vertex. A vertex takes 10 bytes instead of 20.
+//
+// Positions are dequantized by dequantize_matrix, which the geometry
+// stage folds into the model view matrix, so a quantized vertex costs
+// the same transform as a float one.
+////////////////////////////////////////////////////////////////////
+#define QUANTIZE_UNORM_MAX 65535.0f
+
+void init_vertex_quantization(bool enabled);
+
+bool is_vertex_quantization_enabled(void);
+
+// Replace the float vertices of a mesh whose bounds are known by quantized ones
+void quantize_mesh_vertices(mesh_t *mesh);
+
+#endif
@@ -0,0 +1,281 @@
+#define _POSIX_C_SOURCE 200809L // strdup
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scene.h"
+#include "array.h"
+#include "camera.h"
+#include "mesh.h"
+#include "stream.h"
+#include "trace.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define DEG_TO_RAD(angle) ((angle) * (float)M_PI / 180.0f)
+
+#define MAX_SCENE_LINE 1024
+#define MAX_SCENE_TOKENS 32
+
+typedef struct
+{
+    char *obj_filename;
+    char *png_filename; // NULL for meshes without a texture
+    vec3_t scale;
+    vec3_t position;
+    vec3_t rotation;
+    int grid[3];        // Number of copies along x, y and z
+    vec3_t spacing;     // Distance between neighbouring copies
+    bool is_occluder;   // Hides other instances in the occlusion pass
+    int mesh_index;     // Mesh the copies are instances of, -1 until loaded
+} scene_entry_t;
+
+static bool read_floats(char **tokens, int num_tokens, int *next, float *values, int count)
+{
+    if (*next + count > num_tokens)
+        return false;
+
+    // The whole token has to be the number
+    for (int i = 0; i < count; i++)
+    {
+        char *end;
+        values[i] = strtof(tokens[*next + i], &end);
+        if (end == tokens[*next + i] || *end != '\0')
+            return false;
+    }
+    *next += count;
+    return true;
+}
+
+static bool read_vec3(char **tokens, int num_tokens, int *next, vec3_t *value)
+{
+    float values[3];
+    if (!read_floats(tokens, num_tokens, next, values, 3))
+        return false;
+
+    *value = vec3_new(values[0], values[1], values[2]);
+    return true;
+}
+
+static bool read_ints(char **tokens, int num_tokens, int *next, int *values, int count)
+{
+    if (*next + count > num_tokens)
+        return false;
+
+    // Counts are whole numbers of at least 1, written out in full
+    for (int i = 0; i < count; i++)
+    {
+        char *end;
+        long value = strtol(tokens[*next + i], &end, 10);
+        if (end == tokens[*next + i] || *end != '\0' || value < 1 || value > INT_MAX)
+            return false;
+        values[i] = (int)value;
+    }
+    *next += count;
+    return true;
+}
+
+static bool parse_mesh_entry(char **tokens, int num_tokens, scene_entry_t *entry)
+{
+    entry->obj_filename = NULL;
+    entry->png_filename = NULL;
+    if (num_tokens < 3)
+        return false;
+
+    entry->obj_filename = strdup(tokens[1]);
+    entry->png_filename = strcmp(tokens[2], "-") == 0 ? NULL : strdup(tokens[2]);
+    entry->scale = vec3_new(1, 1, 1);
+    entry->position = vec3_new(0, 0, 0);
+    entry->rotation = vec3_new(0, 0, 0);
+    entry->grid[0] = entry->grid[1] = entry->grid[2] = 1;
+    entry->spacing = vec3_new(2, 2, 2);
+    entry->is_occluder = false;
+    entry->mesh_index = -1;
+
+    int next = 3;
+    while (next < num_tokens)
+    {
+        const char *attribute = tokens[next++];
+        bool valid = false;
+
+        if (strcmp(attribute, "scale") == 0)
+        {
+            valid = read_vec3(tokens, num_tokens, &next, &entry->scale);
+        }
+        else if (strcmp(attribute, "position") == 0)
+        {
+            valid = read_vec3(tokens, num_tokens, &next, &entry->position);
+        }
+        else if (strcmp(attribute, "rotation") == 0)
+        {
+            valid = read_vec3(tokens, num_tokens, &next, &entry->rotation);
+            entry->rotation = vec3_new(DEG_TO_RAD(entry->rotation.x), DEG_TO_RAD(entry->rotation.y), DEG_TO_RAD(entry->rotation.z));
+        }
+        else if (strcmp(attribute, "count") == 0)
+        {
+            valid = read_ints(tokens, num_tokens, &next, &entry->grid[0], 1);
+        }
+        else if (strcmp(attribute, "grid") == 0)
+        {
+            valid = read_ints(tokens, num_tokens, &next, entry->grid, 3);
+        }
+        else if (strcmp(attribute, "spacing") == 0)
+        {
+            valid = read_vec3(tokens, num_tokens, &next, &entry->spacing);
+        }
+        else if (strcmp(attribute, "occluder") == 0)
+        {
+            entry->is_occluder = true;
+            valid = true;
+        }
+
+        if (!valid)
+            return false;
+    }
+    return true;
+}
+
+static void free_scene_entries(scene_entry_t *entries)
+{
+    for (int i = 0; i < array_length(entries); i++)
+    {
+        free(entries[i].obj_filename);
+        free(entries[i].png_filename);
+    }
+    array_free(entries);
+}
+
+static bool same_assets(const scene_entry_t *a, const scene_entry_t *b)
+{
+    if (strcmp(a->obj_filename, b->obj_filename) != 0)
+        return false;
+    if (a->png_filename == NULL || b->png_filename == NULL)
+        return a->png_filename == b->png_filename;
+    return strcmp(a->png_filename, b->png_filename) == 0;
+}
+
+////////////////////////////////////////////////////////////////////
+// Loading happens in two passes: the whole file is parsed first so a
+// typo is reported before anything is loaded, then every distinct
+// obj/png pair becomes one mesh and each copy an instance of it. Files
+// used by several meshes are loaded once through the asset registry.
+////////////////////////////////////////////////////////////////////
+bool load_scene(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening scene %s.\n", filename);
+        return false;
+    }
+
+    TRACE_BEGIN("load_scene");
+
+    scene_entry_t *entries = NULL;
+    vec3_t camera_position = vec3_new(0, 0, 0);
+    float camera_angles[2] = {0, 0};
+
+    char line[MAX_SCENE_LINE];
+    int line_number = 0;
+    bool valid = true;
+    while (valid && fgets(line, sizeof(line), file))
+    {
+        line_number++;
+
+        // A line that does not fit would be read back as two
+        if (strchr(line, '\n') == NULL && !feof(file))
+        {
+            fprintf(stderr, "%s:%d: line longer than %d characters.\n", filename, line_number, MAX_SCENE_LINE - 2);
+            valid = false;
+            break;
+        }
+
+        // Drop comments, then split the line into whitespace separated tokens
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char *tokens[MAX_SCENE_TOKENS];
+        int num_tokens = 0;
+        char *token = strtok(line, " \t\r\n");
+        for (; token != NULL && num_tokens < MAX_SCENE_TOKENS; token = strtok(NULL, " \t\r\n"))
+            tokens[num_tokens++] = token;
+
+        if (token != NULL)
+        {
+            fprintf(stderr, "%s:%d: more than %d tokens in scene directive '%s'.\n", filename, line_number, MAX_SCENE_TOKENS, tokens[0]);
+            valid = false;
+            break;
+        }
+        if (num_tokens == 0)
+            continue;
+
+        if (strcmp(tokens[0], "mesh") == 0)
+        {
+            scene_entry_t entry;
+            valid = parse_mesh_entry(tokens, num_tokens, &entry);
+            array_push(entries, entry);
+        }
+        else if (strcmp(tokens[0], "camera") == 0)
+        {
+            int next = 1;
+            valid = read_vec3(tokens, num_tokens, &next, &camera_position) &&
+                    (next == num_tokens || read_floats(tokens, num_tokens, &next, camera_angles, 2)) &&
+                    next == num_tokens;
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+            fprintf(stderr, "%s:%d: invalid scene directive '%s'.\n", filename, line_number, tokens[0]);
+    }
+    fclose(file);
+
+    if (!valid)
+    {
+        free_scene_entries(entries);
+        TRACE_END("load_scene");
+        return false;
+    }
+
+    for (int i = 0; i < array_length(entries); i++)
+    {
+        scene_entry_t *entry = &entries[i];
+
+        // Reuse the mesh of an earlier entry with the same files
+        for (int j = 0; j < i && entry->mesh_index < 0; j++)
+        {
+            if (same_assets(entry, &entries[j]))
+                entry->mesh_index = entries[j].mesh_index;
+        }
+        if (entry->mesh_index < 0)
+            entry->mesh_index = stream_mesh(entry->obj_filename, entry->png_filename);
+        if (entry->is_occluder)
+            get_mesh(entry->mesh_index)->is_occluder = true;
+
+        for (int z = 0; z < entry->grid[2]; z++)
+        {
+            for (int y = 0; y < entry->grid[1]; y++)
+            {
+                for (int x = 0; x < entry->grid[0]; x++)
+                {
+                    vec3_t offset = vec3_new(x * entry->spacing.x, y * entry->spacing.y, z * entry->spacing.z);
+                    vec3_t translation = vec3_add(entry->position, offset);
+                    add_mesh_instance(entry->mesh_index, entry->scale, translation, entry->rotation);
+                }
+            }
+        }
+    }
+
+    init_camera(camera_position, vec3_new(0, 0, 1));
+    rotate_camera_yaw(DEG_TO_RAD(camera_angles[0]));
+    rotate_camera_pitch(DEG_TO_RAD(camera_angles[1]));
+
+    free_scene_entries(entries);
+    TRACE_END("load_scene");
+    return true;
+}
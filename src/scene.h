@@ -0,0 +1,23 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Plain text scene description, one directive per line ('#' starts
+// a comment). Angles are in degrees.
+//
+//   camera <x> <y> <z> [yaw pitch]
+//   mesh <file.obj> <file.png | -> [scale x y z] [position x y z]
+//        [rotation x y z] [count n] [grid nx ny nz] [spacing x y z]
+//        [occluder]
+//
+// count places n copies along x, grid places nx*ny*nz copies on a
+// lattice; copies are spacing apart (default: 2 units on each axis).
+// occluder rasterizes the mesh into the occlusion culling buffer.
+////////////////////////////////////////////////////////////////////
+#define DEFAULT_SCENE_FILE "./assets/default.scene"
+
+bool load_scene(const char *filename);
+
+#endif
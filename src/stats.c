@@ -0,0 +1,33 @@
+#include <string.h>
+#include "stats.h"
+
+frame_stats_t frame_stats;
+
+void reset_frame_stats(void)
+{
+    memset(&frame_stats, 0, sizeof(frame_stats));
+}
+
+frame_stats_t get_frame_stats(void)
+{
+    return frame_stats;
+}
+
+void accumulate_frame_stats(frame_stats_t *total, const frame_stats_t *frame)
+{
+    total->instances_submitted += frame->instances_submitted;
+    total->instances_frustum_culled += frame->instances_frustum_culled;
+    total->instances_occlusion_culled += frame->instances_occlusion_culled;
+    total->meshlets_submitted += frame->meshlets_submitted;
+    total->meshlets_frustum_culled += frame->meshlets_frustum_culled;
+    total->meshlets_backface_culled += frame->meshlets_backface_culled;
+    total->faces_submitted += frame->faces_submitted;
+    total->faces_backface_culled += frame->faces_backface_culled;
+    total->faces_frustum_rejected += frame->faces_frustum_rejected;
+    total->faces_clipped += frame->faces_clipped;
+    total->triangles_emitted += frame->triangles_emitted;
+    total->triangles_rendered += frame->triangles_rendered;
+    total->pixels_tested += frame->pixels_tested;
+    total->pixels_depth_rejected += frame->pixels_depth_rejected;
+    total->pixels_written += frame->pixels_written;
+}
@@ -0,0 +1,38 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Counters of work done by the pipeline during the current frame
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    uint64_t instances_submitted;        // Mesh instances tested against the view frustum
+    uint64_t instances_frustum_culled;   // Instances skipped because their bounds are outside the frustum
+    uint64_t instances_occlusion_culled; // Instances skipped because occluders hide their bounds
+    uint64_t meshlets_submitted;         // Face clusters of the visible instances
+    uint64_t meshlets_frustum_culled;    // Clusters skipped because their sphere is outside the frustum
+    uint64_t meshlets_backface_culled;   // Clusters skipped because all their faces look away
+    uint64_t faces_submitted;            // Mesh faces entering the per-face loop of the geometry stage
+    uint64_t faces_backface_culled;      // Faces skipped because they look away from the camera
+    uint64_t faces_frustum_rejected;     // Faces completely outside the view frustum
+    uint64_t faces_clipped;              // Faces cut by at least one frustum plane
+    uint64_t triangles_emitted;          // Triangles produced by triangles_from_polygon()
+    uint64_t triangles_rendered;         // Screen space triangles sent to the rasterizer
+    uint64_t pixels_tested;              // Pixels covered by a triangle and depth tested
+    uint64_t pixels_depth_rejected;      // Pixels that failed the depth test
+    uint64_t pixels_written;             // Pixels that passed the depth test and were drawn
+} frame_stats_t;
+
+// Incremented directly from the pipeline and rasterizer inner loops, hence global
+extern frame_stats_t frame_stats;
+
+void reset_frame_stats(void);
+
+frame_stats_t get_frame_stats(void);
+
+// Add every counter of a frame to a running total
+void accumulate_frame_stats(frame_stats_t *total, const frame_stats_t *frame);
+
+#endif
@@ -0,0 +1,157 @@
+#define _POSIX_C_SOURCE 200809L // strdup
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "stream.h"
+#include "array.h"
+#include "mesh.h"
+#include "trace.h"
+
+// Stages of a streamed mesh, in loading order
+enum
+{
+    STREAM_QUEUED,
+    STREAM_BOUNDS,
+    STREAM_GEOMETRY,
+    STREAM_TEXTURE
+};
+
+typedef struct
+{
+    char *obj_filename;
+    char *png_filename; // NULL for meshes without a texture
+    int mesh_index;     // Mesh table entry receiving the stages
+    mesh_t mesh;        // Filled by the loader thread
+    int stage;          // Last stage the loader finished, published with release semantics
+    int applied_stage;  // Last stage handed to the mesh table
+} stream_job_t;
+
+static bool streaming_enabled = false;
+static stream_job_t *jobs = NULL;
+static int num_started_jobs = 0;
+static SDL_Thread *loader_thread = NULL;
+static int cancel_requested = 0;
+
+void init_streaming(bool enabled)
+{
+    streaming_enabled = enabled;
+}
+
+static void publish_stage(stream_job_t *job, int stage)
+{
+    __atomic_store_n(&job->stage, stage, __ATOMIC_RELEASE);
+}
+
+// Jobs from first to the end of the array, which does not grow while the thread runs
+static int run_loader(void *data)
+{
+    int first = *(int *)data;
+    trace_set_thread_name("loader");
+    for (int i = first; i < array_length(jobs); i++)
+    {
+        if (__atomic_load_n(&cancel_requested, __ATOMIC_ACQUIRE))
+            break;
+
+        stream_job_t *job = &jobs[i];
+        TRACE_BEGIN_ID("stream_mesh", job->mesh_index);
+        uint64_t begin_ns = begin_mesh_geometry(&job->mesh, job->obj_filename);
+        publish_stage(job, STREAM_BOUNDS);
+        finish_mesh_geometry(&job->mesh, job->obj_filename, begin_ns);
+        publish_stage(job, STREAM_GEOMETRY);
+        load_mesh_texture(&job->mesh, job->png_filename);
+        publish_stage(job, STREAM_TEXTURE);
+        TRACE_END("stream_mesh");
+    }
+    return 0;
+}
+
+int stream_mesh(char *obj_filename, char *png_filename)
+{
+    if (!streaming_enabled)
+        return load_mesh(obj_filename, png_filename);
+
+    // The loader walks the job array, which may only grow while it is stopped
+    if (loader_thread != NULL)
+        wait_for_streaming();
+
+    stream_job_t job = {
+        .obj_filename = strdup(obj_filename),
+        .png_filename = png_filename != NULL ? strdup(png_filename) : NULL,
+        .mesh_index = add_pending_mesh(obj_filename),
+        .stage = STREAM_QUEUED,
+        .applied_stage = STREAM_QUEUED};
+    array_push(jobs, job);
+    return job.mesh_index;
+}
+
+void start_streaming(void)
+{
+    if (loader_thread != NULL || num_started_jobs == array_length(jobs))
+        return;
+
+    static int first_job;
+    first_job = num_started_jobs;
+    num_started_jobs = array_length(jobs);
+    loader_thread = SDL_CreateThread(run_loader, "loader", &first_job);
+
+    // Without a thread the meshes still load, only before the first frame
+    if (loader_thread == NULL)
+        run_loader(&first_job);
+}
+
+void update_streaming(void)
+{
+    for (int i = 0; i < array_length(jobs); i++)
+    {
+        stream_job_t *job = &jobs[i];
+        int stage = __atomic_load_n(&job->stage, __ATOMIC_ACQUIRE);
+        if (stage == job->applied_stage)
+            continue;
+
+        // A box is only worth showing while the geometry is still being processed
+        if (job->applied_stage < STREAM_BOUNDS && stage == STREAM_BOUNDS)
+            set_mesh_placeholder(job->mesh_index, job->mesh.bounds);
+        if (job->applied_stage < STREAM_GEOMETRY && stage >= STREAM_GEOMETRY)
+            set_mesh_geometry(job->mesh_index, &job->mesh);
+        if (job->applied_stage < STREAM_TEXTURE && stage >= STREAM_TEXTURE)
+            set_mesh_texture(job->mesh_index, job->mesh.texture, job->mesh.texture_asset);
+        job->applied_stage = stage;
+    }
+}
+
+void wait_for_streaming(void)
+{
+    if (loader_thread != NULL)
+    {
+        SDL_WaitThread(loader_thread, NULL);
+        loader_thread = NULL;
+    }
+    update_streaming();
+}
+
+bool is_streaming_complete(void)
+{
+    for (int i = 0; i < array_length(jobs); i++)
+        if (jobs[i].applied_stage != STREAM_TEXTURE)
+            return false;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// The loader stops after the mesh it is working on; every finished
+// stage is handed to the mesh table, which frees it with the meshes.
+////////////////////////////////////////////////////////////////////
+void free_streaming(void)
+{
+    __atomic_store_n(&cancel_requested, 1, __ATOMIC_RELEASE);
+    wait_for_streaming();
+    for (int i = 0; i < array_length(jobs); i++)
+    {
+        free(jobs[i].obj_filename);
+        free(jobs[i].png_filename);
+    }
+    array_free(jobs);
+    jobs = NULL;
+    num_started_jobs = 0;
+    cancel_requested = 0;
+}
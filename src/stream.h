@@ -0,0 +1,35 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Background loading of scene meshes. Streamed meshes join the mesh
+// table at once without geometry; a loader thread then loads them in
+// scene order and each one shows up in stages as its data arrives:
+// its bounding box once the OBJ file is parsed (or read from the mesh
+// cache), the full geometry untextured once processed, and finally
+// textured. The loader only fills private copies; the main thread
+// hands the finished stages to the mesh table between frames.
+////////////////////////////////////////////////////////////////////
+void init_streaming(bool enabled);
+
+// Index of a mesh whose files load in the background (or right away
+// when streaming is disabled)
+int stream_mesh(char *obj_filename, char *png_filename);
+
+// Start the loader thread on the meshes queued so far
+void start_streaming(void);
+
+// Apply the stages finished since the last call; called once per frame
+void update_streaming(void);
+
+// Block until every queued mesh is completely loaded
+void wait_for_streaming(void);
+
+// Whether every queued mesh has all its stages in the mesh table
+bool is_streaming_complete(void);
+
+void free_streaming(void);
+
+#endif
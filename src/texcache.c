@@ -0,0 +1,98 @@
+#define _POSIX_C_SOURCE 200809L // munmap, mkdir
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "texcache.h"
+#include "cachefile.h"
+#include "trace.h"
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    int64_t source_size;  // Size of the PNG file the pixels were decoded from
+    uint64_t source_hash; // FNV-1a hash of the bytes of that PNG file
+    uint32_t width;
+    uint32_t height;
+} texture_cache_header_t;
+
+static const char *cache_directory = NULL;
+
+void init_texture_cache(const char *directory)
+{
+    cache_directory = directory;
+}
+
+static bool get_source_identity(const char *png_filename, texture_cache_header_t *header)
+{
+    if (!hash_source_file(png_filename, &header->source_size, &header->source_hash))
+        return false;
+
+    memcpy(header->magic, "TEXR", 4);
+    header->version = TEXTURE_CACHE_VERSION;
+    return true;
+}
+
+upng_t *read_texture_cache(const char *png_filename)
+{
+    texture_cache_header_t expected = {0};
+    if (cache_directory == NULL || !get_source_identity(png_filename, &expected))
+        return NULL;
+
+    char filename[1024];
+    get_cache_filename(cache_directory, png_filename, "texture", filename, sizeof(filename));
+    size_t size;
+    void *mapping = map_file(filename, &size);
+    if (mapping == NULL)
+        return NULL;
+
+    TRACE_BEGIN("read_texture_cache");
+    const texture_cache_header_t *header = mapping;
+    upng_t *texture = NULL;
+    if (size >= sizeof(*header) &&
+        memcmp(header->magic, expected.magic, 4) == 0 &&
+        header->version == expected.version &&
+        header->source_size == expected.source_size &&
+        header->source_hash == expected.source_hash)
+    {
+        // The texture owns the mapping from here on; a truncated file fails the size check
+        texture = upng_new_from_mapped_pixels(mapping, size, TEXTURE_CACHE_ALIGNMENT, header->width, header->height);
+    }
+    TRACE_END("read_texture_cache");
+
+    // A stale or truncated cache file is decoded again from the PNG file
+    if (texture == NULL)
+        munmap(mapping, size);
+    return texture;
+}
+
+void write_texture_cache(const char *png_filename, const upng_t *texture)
+{
+    // Only the 8 bit RGBA layout read by the texture sampler is cached
+    texture_cache_header_t header = {0};
+    if (cache_directory == NULL || upng_get_format(texture) != UPNG_RGBA8 || !get_source_identity(png_filename, &header))
+        return;
+
+    // The directory may already exist, opening the file reports real failures
+    mkdir(cache_directory, 0755);
+
+    // Written aside and renamed over the old file, which other runs may still have mapped
+    char filename[1024], temporary[1040];
+    get_cache_filename(cache_directory, png_filename, "texture", filename, sizeof(filename));
+    FILE *file = create_cache_file(filename, temporary, sizeof(temporary));
+    if (file == NULL)
+        return;
+
+    // Pad the header so the pixels start on an aligned offset of the mapping
+    unsigned char padding[TEXTURE_CACHE_ALIGNMENT] = {0};
+    header.width = upng_get_width(texture);
+    header.height = upng_get_height(texture);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(padding, 1, TEXTURE_CACHE_ALIGNMENT - sizeof(header), file);
+    bool written = fwrite(upng_get_buffer(texture), 1, upng_get_size(texture), file) == upng_get_size(texture);
+    commit_cache_file(file, written, temporary, filename);
+}
@@ -0,0 +1,26 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include "upng.h"
+
+////////////////////////////////////////////////////////////////////
+// Cache of decoded textures. The 8 bit RGBA pixels of every decoded
+// PNG file are written raw to the cache directory behind a small
+// header, and later launches map that file straight into the texture
+// instead of decoding the PNG again. A cache file is used for as long
+// as the size and FNV-1a hash of the PNG bytes match the ones it was
+// built from.
+// Bump TEXTURE_CACHE_VERSION whenever the layout changes.
+////////////////////////////////////////////////////////////////////
+#define TEXTURE_CACHE_VERSION 1
+#define TEXTURE_CACHE_ALIGNMENT 64 // Offset of the pixels in a cache file
+
+// NULL disables the cache
+void init_texture_cache(const char *directory);
+
+// Map the decoded pixels of a PNG file from its cache file, NULL on a miss
+upng_t *read_texture_cache(const char *png_filename);
+
+void write_texture_cache(const char *png_filename, const upng_t *texture);
+
+#endif
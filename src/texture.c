@@ -1,7 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
 #include "texture.h"
+#include "array.h"
+#include "trace.h"
+
+static bool compression_enabled = false;
+
+// Dynamic array of registered textures, NULL where one was freed
+static texture_t **texture_table = NULL;
+static texture_rect_t *rect_table = NULL; // Rectangle of every slot of texture_table
 
 tex2_t tex2_clone(tex2_t *t)
 {
     tex2_t result = {t->u, t->v};
     return result;
-}
\ No newline at end of file
+}
+
+void init_texture_compression(bool enabled)
+{
+    compression_enabled = enabled;
+}
+
+////////////////////////////////////////////////////////////////////
+// BC1 colors. Channels are numbered in texel byte order, so channel
+// 0 (the low byte of a texel) takes the 5 high bits of RGB565.
+////////////////////////////////////////////////////////////////////
+static void expand_565(uint16_t color, int channels[3])
+{
+    int c0 = color >> 11, c1 = (color >> 5) & 63, c2 = color & 31;
+    channels[0] = (c0 << 3) | (c0 >> 2);
+    channels[1] = (c1 << 2) | (c1 >> 4);
+    channels[2] = (c2 << 3) | (c2 >> 2);
+}
+
+static uint16_t pack_565(const int channels[3])
+{
+    int c0 = (channels[0] * 31 + 127) / 255;
+    int c1 = (channels[1] * 63 + 127) / 255;
+    int c2 = (channels[2] * 31 + 127) / 255;
+    return (uint16_t)((c0 << 11) | (c1 << 5) | c2);
+}
+
+// Color picked by a 2-bit index of a block, as an opaque texel
+static uint32_t decode_bc1_color(uint16_t color0, uint16_t color1, int index)
+{
+    // Thirds of each endpoint mixed in by the four color mode
+    static const int weight0[4] = {3, 0, 2, 1};
+    static const int weight1[4] = {0, 3, 1, 2};
+
+    int a[3], b[3], c[3];
+    expand_565(color0, a);
+    expand_565(color1, b);
+    if (color0 > color1)
+    {
+        // The three channels sit in 21-bit lanes of one integer, so a single
+        // multiply mixes them all; x * 683 >> 11 is x / 3 for x up to 3 * 255
+        uint64_t lanes_a = (uint64_t)a[0] | (uint64_t)a[1] << 21 | (uint64_t)a[2] << 42;
+        uint64_t lanes_b = (uint64_t)b[0] | (uint64_t)b[1] << 21 | (uint64_t)b[2] << 42;
+        uint64_t mixed = (weight0[index] * lanes_a + weight1[index] * lanes_b) * 683;
+        return 0xFF000000 | (uint32_t)((mixed >> 53) & 0xFF) << 16 | (uint32_t)((mixed >> 32) & 0xFF) << 8 | (uint32_t)((mixed >> 11) & 0xFF);
+    }
+    for (int i = 0; i < 3; i++)
+        c[i] = index == 0 ? a[i] : index == 1 ? b[i] : index == 2 ? (a[i] + b[i]) / 2 : 0;
+    return 0xFF000000 | (uint32_t)c[2] << 16 | (uint32_t)c[1] << 8 | (uint32_t)c[0];
+}
+
+////////////////////////////////////////////////////////////////////
+// Encode 16 texels: the endpoints are the two texels farthest apart
+// along the principal axis of the block colors (a few power
+// iterations on their covariance), then every texel takes the index
+// of the nearest of the four colors the decoder will produce.
+////////////////////////////////////////////////////////////////////
+static bc1_block_t encode_bc1_block(const uint32_t texels[16])
+{
+    int colors[16][3];
+    float mean[3] = {0, 0, 0};
+    int min[3] = {255, 255, 255}, max[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            colors[i][c] = (texels[i] >> (8 * c)) & 0xFF;
+            mean[c] += colors[i][c] / 16.0f;
+            min[c] = colors[i][c] < min[c] ? colors[i][c] : min[c];
+            max[c] = colors[i][c] > max[c] ? colors[i][c] : max[c];
+        }
+    }
+
+    float covariance[3][3] = {{0}};
+    for (int i = 0; i < 16; i++)
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 3; c++)
+                covariance[r][c] += (colors[i][r] - mean[r]) * (colors[i][c] - mean[c]);
+
+    // Start from the diagonal of the bounding box, which is already close for most blocks
+    float axis[3] = {max[0] - min[0], max[1] - min[1], max[2] - min[2]};
+    for (int iteration = 0; iteration < 4; iteration++)
+    {
+        float next[3];
+        float largest = 0;
+        for (int r = 0; r < 3; r++)
+        {
+            next[r] = covariance[r][0] * axis[0] + covariance[r][1] * axis[1] + covariance[r][2] * axis[2];
+            largest = fabsf(next[r]) > largest ? fabsf(next[r]) : largest;
+        }
+        if (largest == 0)
+            break;
+        for (int r = 0; r < 3; r++)
+            axis[r] = next[r] / largest;
+    }
+
+    float lowest = FLT_MAX, highest = -FLT_MAX;
+    int low = 0, high = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = colors[i][0] * axis[0] + colors[i][1] * axis[1] + colors[i][2] * axis[2];
+        if (t < lowest)
+        {
+            lowest = t;
+            low = i;
+        }
+        if (t > highest)
+        {
+            highest = t;
+            high = i;
+        }
+    }
+
+    // color0 > color1 selects the four color mode; equal endpoints only need index 0
+    bc1_block_t block = {pack_565(colors[high]), pack_565(colors[low]), 0};
+    if (block.color0 < block.color1)
+    {
+        uint16_t swap = block.color0;
+        block.color0 = block.color1;
+        block.color1 = swap;
+    }
+    if (block.color0 == block.color1)
+        return block;
+
+    int palette[4][3];
+    for (int index = 0; index < 4; index++)
+    {
+        uint32_t color = decode_bc1_color(block.color0, block.color1, index);
+        for (int c = 0; c < 3; c++)
+            palette[index][c] = (color >> (8 * c)) & 0xFF;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, best_distance = 0;
+        for (int index = 0; index < 4; index++)
+        {
+            int distance = 0;
+            for (int c = 0; c < 3; c++)
+                distance += (colors[i][c] - palette[index][c]) * (colors[i][c] - palette[index][c]);
+            if (index == 0 || distance < best_distance)
+            {
+                best = index;
+                best_distance = distance;
+            }
+        }
+        block.indices |= (uint32_t)best << (2 * i);
+    }
+    return block;
+}
+
+// Replace the texels of a texture with BC1 blocks; blocks past the
+// right and bottom edges repeat the last column and row
+static void compress_texture(texture_t *texture)
+{
+    int blocks_per_row = (texture->width + 3) / 4;
+    int block_rows = (texture->height + 3) / 4;
+    bc1_block_t *blocks = malloc(sizeof(bc1_block_t) * blocks_per_row * block_rows);
+    if (blocks == NULL)
+        return;
+
+    TRACE_BEGIN("compress_bc1");
+    for (int by = 0; by < block_rows; by++)
+    {
+        for (int bx = 0; bx < blocks_per_row; bx++)
+        {
+            uint32_t texels[16];
+            for (int i = 0; i < 16; i++)
+            {
+                int x = bx * 4 + (i & 3);
+                int y = by * 4 + (i >> 2);
+                x = x < texture->width ? x : texture->width - 1;
+                y = y < texture->height ? y : texture->height - 1;
+                texels[i] = texture->texels[y * texture->width + x];
+            }
+            blocks[by * blocks_per_row + bx] = encode_bc1_block(texels);
+        }
+    }
+    TRACE_END("compress_bc1");
+
+    upng_free(texture->image);
+    texture->image = NULL;
+    texture->texels = NULL;
+    texture->format = TEXTURE_BC1;
+    texture->blocks = blocks;
+    texture->blocks_per_row = blocks_per_row;
+}
+
+texture_t *create_texture(upng_t *image)
+{
+    texture_t *texture = calloc(1, sizeof(texture_t));
+    if (texture == NULL)
+    {
+        upng_free(image);
+        return NULL;
+    }
+
+    texture->width = upng_get_width(image);
+    texture->height = upng_get_height(image);
+    texture->format = TEXTURE_RGBA;
+    texture->image = image;
+    texture->texels = (const uint32_t *)upng_get_buffer(image);
+    texture->index = -1;
+    texture->page = -1;
+
+    // Only 8 bit RGBA images hold the 32-bit texels the encoder reads
+    if (compression_enabled && upng_get_format(image) == UPNG_RGBA8)
+        compress_texture(texture);
+    return texture;
+}
+
+void free_texture(texture_t *texture)
+{
+    if (texture->index >= 0)
+        texture_table[texture->index] = NULL;
+
+    if (texture->image != NULL)
+        upng_free(texture->image);
+    free(texture->blocks);
+    free(texture);
+}
+
+size_t get_texture_memory(const texture_t *texture)
+{
+    if (texture->format == TEXTURE_BC1)
+        return sizeof(bc1_block_t) * texture->blocks_per_row * ((texture->height + 3) / 4);
+    if (texture->image != NULL)
+        return upng_get_size(texture->image);
+    // An atlas page holds its texels itself, a packed texture has none left
+    return texture->texels != NULL ? sizeof(uint32_t) * texture->width * texture->height : 0;
+}
+
+uint32_t get_texel(const texture_t *texture, int x, int y)
+{
+    if (texture->format == TEXTURE_RGBA)
+        return texture->texels[y * texture->width + x];
+
+    const bc1_block_t *block = &texture->blocks[(y >> 2) * texture->blocks_per_row + (x >> 2)];
+    int index = (block->indices >> (2 * (4 * (y & 3) + (x & 3)))) & 3;
+    return decode_bc1_color(block->color0, block->color1, index);
+}
+
+int register_texture(texture_t *texture)
+{
+    if (texture->index < 0)
+    {
+        // Past the last slot the texture stays unregistered, and is drawn flat shaded
+        if (array_length(texture_table) == MAX_TEXTURE_SLOTS)
+        {
+            fprintf(stderr, "Texture table full, at most %d textures.\n", MAX_TEXTURE_SLOTS);
+            return -1;
+        }
+
+        texture_rect_t rect = {0, 0, texture->width, texture->height};
+        texture->index = array_length(texture_table);
+        texture->page = texture->index;
+        array_push(texture_table, texture);
+        array_push(rect_table, rect);
+    }
+    return texture->index;
+}
+
+texture_t *get_texture(int index)
+{
+    return index >= 0 ? texture_table[index] : NULL;
+}
+
+const texture_rect_t *get_texture_rect(int index)
+{
+    return &rect_table[index];
+}
+
+void move_texture_to_atlas(texture_t *texture, const texture_t *page, int x, int y)
+{
+    if (texture->image != NULL)
+        upng_free(texture->image);
+    texture->image = NULL;
+    texture->texels = NULL;
+    texture->page = page->index;
+    rect_table[texture->index].x = x;
+    rect_table[texture->index].y = y;
+}
+
+void free_texture_table(void)
+{
+    array_free(texture_table);
+    array_free(rect_table);
+    texture_table = NULL;
+    rect_table = NULL;
+}
@@ -1,6 +1,11 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "upng.h"
+
 typedef struct
 {
     float u;
@@ -9,4 +14,79 @@ typedef struct
 
 tex2_t tex2_clone(tex2_t *t);
 
-#endif
\ No newline at end of file
+////////////////////////////////////////////////////////////////////
+// A mesh texture, sampled one texel at a time by the rasterizer.
+// Textures keep the 32-bit texels of the decoded PNG, or with
+// compression on they are encoded at load into BC1 (DXT1) blocks:
+// every 4x4 texels share two RGB565 endpoint colors and pick one of
+// four colors on the line between them with 2 bits each, 4 bits per
+// texel instead of 32. BC1 texels are decoded on every fetch and have
+// an opaque alpha.
+////////////////////////////////////////////////////////////////////
+typedef enum
+{
+    TEXTURE_RGBA,
+    TEXTURE_BC1
+} texture_format_t;
+
+typedef struct
+{
+    uint16_t color0;  // RGB565 endpoints; color0 > color1 selects four colors
+    uint16_t color1;
+    uint32_t indices; // 2 bits per texel, texel (x, y) at bit 2 * (4 * y + x)
+} bc1_block_t;
+
+typedef struct
+{
+    int width;
+    int height;
+    texture_format_t format;
+    upng_t *image;          // TEXTURE_RGBA: decoded PNG holding the texels
+    const uint32_t *texels; // Row by row, NULL once moved into an atlas page
+    bc1_block_t *blocks;    // TEXTURE_BC1: blocks row by row, edges padded
+    int blocks_per_row;
+    int index;              // Texture table slot, -1 until registered
+    int page;               // Table slot of the texture holding the texels: index, or an atlas page
+} texture_t;
+
+// Texels of a table slot inside the texture at its page slot
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} texture_rect_t;
+
+void init_texture_compression(bool enabled);
+
+// Takes ownership of a decoded image, which is freed once compressed
+texture_t *create_texture(upng_t *image);
+
+void free_texture(texture_t *texture);
+
+size_t get_texture_memory(const texture_t *texture);
+
+// Color of the texel at (x, y), both inside the texture
+uint32_t get_texel(const texture_t *texture, int x, int y);
+
+////////////////////////////////////////////////////////////////////
+// Table of the textures in use. Triangles carry two small slots of
+// this table instead of a texture pointer: the page slot of the
+// texture holding the texels, and the slot of the mesh texture, whose
+// rectangle in that page the uv wraps in. Textures packed into the
+// same atlas page share their page slot. Only the main thread touches
+// the table.
+////////////////////////////////////////////////////////////////////
+#define MAX_TEXTURE_SLOTS 32767 // Slots fit the 16-bit fields of a raster triangle
+
+int register_texture(texture_t *texture);
+texture_t *get_texture(int index);
+const texture_rect_t *get_texture_rect(int index);
+
+// Release the texels of a registered texture now copied into a
+// registered atlas page, its first texel at (x, y) of the page
+void move_texture_to_atlas(texture_t *texture, const texture_t *page, int x, int y);
+void free_texture_table(void);
+
+#endif
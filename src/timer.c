@@ -0,0 +1,10 @@
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include "timer.h"
+
+uint64_t get_time_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
@@ -0,0 +1,12 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Monotonic clock with nanosecond resolution, unaffected by the
+// system time changing while the program runs.
+////////////////////////////////////////////////////////////////////
+uint64_t get_time_ns(void);
+
+#endif
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "trace.h"
+#include "timer.h"
+
+#define MAX_TRACE_THREADS 64
+#define TRACE_BUFFER_CAPACITY (1 << 16)
+
+typedef struct
+{
+    const char *name;
+    uint64_t timestamp_ns;
+    int id;
+    char phase; // 'B' (begin) or 'E' (end)
+} trace_event_t;
+
+////////////////////////////////////////////////////////////////////
+// Each thread owns one ring buffer and is the only one appending to
+// it; event n lives in slot n % capacity. The count of events ever
+// recorded is published with release semantics, and the thread
+// writing the capture reads up to an acquired snapshot of it without
+// a lock. A capture reads events from capture_start on, or only the
+// newest capacity of them once the ring has wrapped over the older
+// ones.
+//
+// Producers keep recording while the capture is written, so a slot
+// can be overwritten while it is read. Event fields are copied with
+// atomic loads and checked like a sequence lock: a producer only
+// writes event n + capacity into the slot of event n after it has
+// published a count of n + capacity, so a copy is intact when the
+// count read after it is still below that.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    trace_event_t events[TRACE_BUFFER_CAPACITY];
+    unsigned count;
+    unsigned capture_start;
+    int thread_id;
+    const char *thread_name;
+} trace_buffer_t;
+
+int trace_active = 0;
+
+static trace_buffer_t *buffers[MAX_TRACE_THREADS];
+static int num_buffers = 0;
+static __thread trace_buffer_t *thread_buffer = NULL;
+static __thread const char *thread_name = NULL;
+
+static const char *trace_filename = "trace.json";
+static int frames_remaining = 0;
+static uint64_t capture_start_ns = 0;
+static int capture_index = 0;
+
+static trace_buffer_t *get_thread_buffer(void)
+{
+    if (thread_buffer != NULL)
+        return thread_buffer;
+
+    int slot = __atomic_fetch_add(&num_buffers, 1, __ATOMIC_ACQ_REL);
+    if (slot >= MAX_TRACE_THREADS)
+        return NULL;
+
+    trace_buffer_t *buffer = (trace_buffer_t *)calloc(1, sizeof(trace_buffer_t));
+    if (buffer == NULL)
+        return NULL;
+    buffer->thread_id = slot + 1;
+    buffer->thread_name = thread_name;
+
+    __atomic_store_n(&buffers[slot], buffer, __ATOMIC_RELEASE);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+static void record_event(const char *name, int id, char phase)
+{
+    trace_buffer_t *buffer = get_thread_buffer();
+    if (buffer == NULL)
+        return;
+
+    // Only this thread writes the count; the fence keeps the slot writes
+    // after the count published by the previous event
+    unsigned count = __atomic_load_n(&buffer->count, __ATOMIC_RELAXED);
+    trace_event_t *event = &buffer->events[count % TRACE_BUFFER_CAPACITY];
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&event->name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->timestamp_ns, get_time_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(&event->id, id, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->phase, phase, __ATOMIC_RELAXED);
+    __atomic_store_n(&buffer->count, count + 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char *name, int id)
+{
+    record_event(name, id, 'B');
+}
+
+void trace_end(const char *name)
+{
+    record_event(name, -1, 'E');
+}
+
+void trace_set_thread_name(const char *name)
+{
+    // The buffer is only allocated once the thread records its first event
+    thread_name = name;
+    if (thread_buffer != NULL)
+        __atomic_store_n(&thread_buffer->thread_name, name, __ATOMIC_RELEASE);
+}
+
+void init_trace(const char *filename)
+{
+    if (filename != NULL)
+        trace_filename = filename;
+    trace_set_thread_name("main");
+}
+
+void start_trace_capture(int num_frames)
+{
+    if (TRACE_IS_ACTIVE())
+        return;
+
+    // Skip whatever earlier captures left in the buffers
+    int count = __atomic_load_n(&num_buffers, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count && i < MAX_TRACE_THREADS; i++)
+    {
+        trace_buffer_t *buffer = __atomic_load_n(&buffers[i], __ATOMIC_ACQUIRE);
+        if (buffer != NULL)
+            buffer->capture_start = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+    }
+
+    frames_remaining = num_frames > 0 ? num_frames : TRACE_DEFAULT_FRAMES;
+    capture_start_ns = get_time_ns();
+    __atomic_store_n(&trace_active, 1, __ATOMIC_RELEASE);
+}
+
+static void write_trace(void)
+{
+    // Number the files of repeated captures after the first one
+    char filename[1024];
+    if (capture_index == 0)
+        snprintf(filename, sizeof(filename), "%s", trace_filename);
+    else
+        snprintf(filename, sizeof(filename), "%s.%d", trace_filename, capture_index);
+    capture_index++;
+
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening %s for writing.\n", filename);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    int num_events = 0;
+    int num_dropped = 0;
+
+    int count = __atomic_load_n(&num_buffers, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count && i < MAX_TRACE_THREADS; i++)
+    {
+        trace_buffer_t *buffer = __atomic_load_n(&buffers[i], __ATOMIC_ACQUIRE);
+        if (buffer == NULL)
+            continue;
+
+        const char *name = __atomic_load_n(&buffer->thread_name, __ATOMIC_ACQUIRE);
+        if (name != NULL)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->thread_id, name);
+            first = false;
+        }
+
+        // Unsigned differences stay right when the counts wrap around
+        unsigned end = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        unsigned start = buffer->capture_start;
+        if (end - start > TRACE_BUFFER_CAPACITY)
+        {
+            num_dropped += end - start - TRACE_BUFFER_CAPACITY;
+            start = end - TRACE_BUFFER_CAPACITY;
+        }
+        for (unsigned e = start; e != end; e++)
+        {
+            const trace_event_t *slot = &buffer->events[e % TRACE_BUFFER_CAPACITY];
+            trace_event_t event = {
+                __atomic_load_n(&slot->name, __ATOMIC_RELAXED),
+                __atomic_load_n(&slot->timestamp_ns, __ATOMIC_RELAXED),
+                __atomic_load_n(&slot->id, __ATOMIC_RELAXED),
+                __atomic_load_n(&slot->phase, __ATOMIC_RELAXED)};
+
+            // A producer that got around the ring meanwhile may have torn the copy
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&buffer->count, __ATOMIC_RELAXED) - e >= TRACE_BUFFER_CAPACITY)
+            {
+                num_dropped++;
+                continue;
+            }
+
+            // Events recorded before the capture started (e.g. on other threads) are left out
+            if (event.timestamp_ns < capture_start_ns)
+                continue;
+
+            double timestamp_us = (event.timestamp_ns - capture_start_ns) / 1000.0;
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+                    first ? "" : ",\n", event.name, event.phase, timestamp_us, buffer->thread_id);
+            if (event.id >= 0)
+                fprintf(file, ",\"args\":{\"id\":%d}", event.id);
+            fprintf(file, "}");
+            first = false;
+            num_events++;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote %d trace events to %s", num_events, filename);
+    if (num_dropped > 0)
+        printf(" (%d dropped, trace buffers wrapped)", num_dropped);
+    printf("\n");
+}
+
+void trace_end_frame(void)
+{
+    if (!TRACE_IS_ACTIVE())
+        return;
+
+    if (--frames_remaining <= 0)
+    {
+        __atomic_store_n(&trace_active, 0, __ATOMIC_RELEASE);
+        write_trace();
+    }
+}
+
+void free_trace(void)
+{
+    // Flush a capture cut short by the program exiting
+    if (TRACE_IS_ACTIVE())
+    {
+        __atomic_store_n(&trace_active, 0, __ATOMIC_RELEASE);
+        write_trace();
+    }
+
+    int count = __atomic_load_n(&num_buffers, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count && i < MAX_TRACE_THREADS; i++)
+    {
+        free(buffers[i]);
+        buffers[i] = NULL;
+    }
+    num_buffers = 0;
+    thread_buffer = NULL;
+}
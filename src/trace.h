@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////
+// Timeline tracing in the Chrome trace-event JSON format, viewable in
+// about:tracing or Perfetto. Every thread records begin/end events
+// into its own buffer without locks; a capture covers a number of
+// frames and is written to disk when the last one finishes.
+////////////////////////////////////////////////////////////////////
+#define TRACE_DEFAULT_FRAMES 10
+
+// Nonzero while a capture is running, read and written with atomic
+// builtins from every thread. Checked inline so disabled tracing
+// costs a single relaxed load and branch per event.
+extern int trace_active;
+#define TRACE_IS_ACTIVE() __atomic_load_n(&trace_active, __ATOMIC_RELAXED)
+
+#define TRACE_BEGIN(name)              \
+    do                                 \
+    {                                  \
+        if (TRACE_IS_ACTIVE())         \
+            trace_begin((name), -1);   \
+    } while (0)
+
+#define TRACE_BEGIN_ID(name, id)       \
+    do                                 \
+    {                                  \
+        if (TRACE_IS_ACTIVE())         \
+            trace_begin((name), (id)); \
+    } while (0)
+
+#define TRACE_END(name)                \
+    do                                 \
+    {                                  \
+        if (TRACE_IS_ACTIVE())         \
+            trace_end(name);           \
+    } while (0)
+
+void init_trace(const char *filename);
+void free_trace(void);
+
+// Start capturing the next num_frames frames (ignored while a capture runs)
+void start_trace_capture(int num_frames);
+
+// Name the calling thread in the timeline (e.g. "main", "loader 1")
+void trace_set_thread_name(const char *name);
+
+// Event names must be string literals or otherwise outlive the capture
+void trace_begin(const char *name, int id);
+void trace_end(const char *name);
+
+// Count a finished frame and write the capture once it is complete
+void trace_end_frame(void);
+
+#endif
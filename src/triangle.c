@@ -1,7 +1,13 @@
 #include <stdint.h>
+#include <math.h>
 #include "triangle.h"
 #include "display.h"
 #include "swap.h"
+#include "stats.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 vec3_t get_triangle_normal(vec4_t vertices[3])
 {
@@ -24,78 +30,136 @@ vec3_t get_triangle_normal(vec4_t vertices[3])
 }
 
 ////////////////////////////////////////////////////////////////////
-// Return the barycentric weights alpha, beta and gamma for point p
+// Fit the plane through the values of an attribute at the three
+// vertices, at their subpixel positions relative to vertex 0. A
+// triangle without area gets a NaN plane, which fails every depth
+// test like the barycentric weights of such a triangle used to.
 ////////////////////////////////////////////////////////////////////
-//
-//            B
-//          / | \
-//         /  |  \
-//        /   |   \
-//       /   (p)   \
-//      /  /     \  \
-//     / /         \ \
-//    A ------------- C
-//
-////////////////////////////////////////////////////////////////////
-vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p)
+static raster_plane_t get_raster_plane(const raster_triangle_t *triangle, float a0, float a1, float a2)
 {
-    // Find the vectors between vertices ABC and point P
-    vec2_t ac = vec2_sub(c, a);
-    vec2_t ab = vec2_sub(b, a);
-    vec2_t ap = vec2_sub(p, a);
-    vec2_t pc = vec2_sub(c, p);
-    vec2_t pb = vec2_sub(b, p);
+    float x1 = (float)(triangle->x[1] - triangle->x[0]) / RASTER_SUBPIXEL_SCALE;
+    float y1 = (float)(triangle->y[1] - triangle->y[0]) / RASTER_SUBPIXEL_SCALE;
+    float x2 = (float)(triangle->x[2] - triangle->x[0]) / RASTER_SUBPIXEL_SCALE;
+    float y2 = (float)(triangle->y[2] - triangle->y[0]) / RASTER_SUBPIXEL_SCALE;
+    float area = x1 * y2 - x2 * y1;
+    if (area == 0)
+    {
+        raster_plane_t plane = {NAN, NAN, NAN};
+        return plane;
+    }
 
-    // Calculate the area of the full parallelogram/triangle ABC using 2D cross product
-    float area_parallelogram_abc = (ac.x * ab.y - ac.y * ab.x); // || AC x AB ||
+    raster_plane_t plane = {
+        a0,
+        ((a1 - a0) * y2 - (a2 - a0) * y1) / area,
+        ((a2 - a0) * x1 - (a1 - a0) * x2) / area};
+    return plane;
+}
 
-    // Alpha is the area of the small parallelogram/triangle PBC divided by the area of the full parallelogram/triangle ABC
-    float alpha = (pc.x * pb.y - pc.y * pb.x) / area_parallelogram_abc;
+void setup_raster_triangle(
+    raster_triangle_t *triangle, const vec4_t points[3], const tex2_t texcoords[3],
+    uint32_t color, const texture_t *texture)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        triangle->x[i] = (int32_t)(points[i].x * RASTER_SUBPIXEL_SCALE);
+        triangle->y[i] = (int32_t)(points[i].y * RASTER_SUBPIXEL_SCALE);
+    }
 
-    // Beta is the area of the small parallelogram/triangle APC divided by the area of the full parallelogram/triangle ABC
-    float beta = (ac.x * ap.y - ac.y * ap.x) / area_parallelogram_abc;
+    float reciprocal_w[3];
+    float u_over_w[3];
+    float v_over_w[3];
+    for (int i = 0; i < 3; i++)
+    {
+        // V grows downwards in the texture (origin at the top-left), so it is flipped here
+        reciprocal_w[i] = 1 / points[i].w;
+        u_over_w[i] = texcoords[i].u * reciprocal_w[i];
+        v_over_w[i] = (1 - texcoords[i].v) * reciprocal_w[i];
+    }
+    triangle->reciprocal_w = get_raster_plane(triangle, reciprocal_w[0], reciprocal_w[1], reciprocal_w[2]);
+    triangle->u_over_w = get_raster_plane(triangle, u_over_w[0], u_over_w[1], u_over_w[2]);
+    triangle->v_over_w = get_raster_plane(triangle, v_over_w[0], v_over_w[1], v_over_w[2]);
+    triangle->color = color;
+    // Packed textures are sampled from their atlas page
+    bool textured = texture != NULL && texture->index >= 0;
+    triangle->texture = textured ? texture->page : -1;
+    triangle->texture_rect = textured ? texture->index : -1;
+}
 
-    // Gamma can be inferred by the difference of alpha, beta and 1
-    float gamma = 1 - alpha - beta;
+// Screen position of vertex 0, where the planes take their stored values
+static void get_raster_origin(const raster_triangle_t *triangle, float *origin_x, float *origin_y)
+{
+    *origin_x = (float)triangle->x[0] / RASTER_SUBPIXEL_SCALE;
+    *origin_y = (float)triangle->y[0] / RASTER_SUBPIXEL_SCALE;
+}
 
-    vec3_t weights = {alpha, beta, gamma};
-    return weights;
+// Value of a plane at the center of pixel (x, y)
+static inline float get_plane_value(raster_plane_t plane, float origin_x, float origin_y, int x, int y)
+{
+    return plane.value + plane.dx * (x + 0.5f - origin_x) + plane.dy * (y + 0.5f - origin_y);
+}
+
+// Whole pixels of the vertices sorted by ascending y (y0 < y1 < y2)
+static void sort_raster_vertices(const raster_triangle_t *triangle, int x[3], int y[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = get_raster_pixel(triangle->x[i]);
+        y[i] = get_raster_pixel(triangle->y[i]);
+    }
+    if (y[0] > y[1])
+    {
+        int_swap(&y[0], &y[1]);
+        int_swap(&x[0], &x[1]);
+    }
+    if (y[1] > y[2])
+    {
+        int_swap(&y[1], &y[2]);
+        int_swap(&x[1], &x[2]);
+    }
+    if (y[0] > y[1])
+    {
+        int_swap(&y[0], &y[1]);
+        int_swap(&x[0], &x[1]);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////
 // Draw a solid pixel at position (x,y) using depth interpolation.
 ////////////////////////////////////////////////////////////////////
-void draw_triangle_pixel(
-    int x, int y, uint32_t color,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c)
+static void draw_triangle_pixel(int x, int y, float reciprocal_w, uint32_t color)
 {
-    vec2_t p = {x, y};
-    vec2_t a = vec2_from_vec4(point_a);
-    vec2_t b = vec2_from_vec4(point_b);
-    vec2_t c = vec2_from_vec4(point_c);
-
-    vec3_t weights = barycentric_weights(a, b, c, p);
-
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    // Interpolate value of 1/w for the current pixel.
-    float interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
-
     // Adjust 1/w so the pixels that are closer to camera have smaller values (0).
     // and pixels further away from camera have bigger values (1)
-    interpolated_reciprocal_w = 1 - interpolated_reciprocal_w;
+    float depth = 1 - reciprocal_w;
+
+    frame_stats.pixels_tested++;
 
     // Only draw pixel if depth value is less than the one previously stored in z-buffer
     // This way, only render this pixel if it is closer to the camera than whatever pixel was there before
-    if (interpolated_reciprocal_w < get_z_buffer_at(x, y))
+    if (depth < get_z_buffer_at(x, y))
     {
         // Draw a pixel at position (x,y) with the a solid color
         draw_pixel(x, y, color);
 
         // Update the z-buffer value with 1/w of the current pixel
-        update_z_buffer_at(x, y, interpolated_reciprocal_w);
+        update_z_buffer_at(x, y, depth);
+
+        frame_stats.pixels_written++;
+    }
+    else
+    {
+        frame_stats.pixels_depth_rejected++;
+    }
+}
+
+// Fill the pixels from x_start up to x_end, stepping 1/w by its plane's dx
+static void draw_filled_span(const raster_triangle_t *triangle, float origin_x, float origin_y, int y, int x_start, int x_end)
+{
+    float reciprocal_w = get_plane_value(triangle->reciprocal_w, origin_x, origin_y, x_start, y);
+    for (int x = x_start; x < x_end; x++)
+    {
+        draw_triangle_pixel(x, y, reciprocal_w, triangle->color);
+        reciprocal_w += triangle->reciprocal_w.dx;
     }
 }
 
@@ -117,39 +181,14 @@ void draw_triangle_pixel(
 //                         (x2,y2)
 //
 ////////////////////////////////////////////////////////////////////
-void draw_filled_triangle(
-    int x0, int y0, float z0, float w0,
-    int x1, int y1, float z1, float w1,
-    int x2, int y2, float z2, float w2,
-    uint32_t color)
+void draw_filled_triangle(const raster_triangle_t *triangle)
 {
-    // Sort the vertices by ascending y-coordinate values (y0 < y1 < y2)
-    if (y0 > y1)
-    {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-    }
-    if (y1 > y2)
-    {
-        int_swap(&y1, &y2);
-        int_swap(&x1, &x2);
-        float_swap(&z1, &z2);
-        float_swap(&w1, &w2);
-    }
-    if (y0 > y1)
-    {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-    }
+    int x[3], y[3];
+    sort_raster_vertices(triangle, x, y);
+    int x0 = x[0], y0 = y[0], x1 = x[1], y1 = y[1], x2 = x[2], y2 = y[2];
 
-    // Create three vector points after sorting vertices
-    vec4_t point_a = {x0, y0, z0, w0};
-    vec4_t point_b = {x1, y1, z1, w1};
-    vec4_t point_c = {x2, y2, z2, w2};
+    float origin_x, origin_y;
+    get_raster_origin(triangle, &origin_x, &origin_y);
 
     ///////////////////////////////////////////////////////
     // Render the upper part of the triangle (flat-bottom)
@@ -172,11 +211,7 @@ void draw_filled_triangle(
             if (x_end < x_start)
                 int_swap(&x_start, &x_end); // Swap if x_start is to the is to the right of x_end
 
-            for (int x = x_start; x < x_end; x++)
-            {
-                // Draw pixel with a solid color
-                draw_triangle_pixel(x, y, color, point_a, point_b, point_c);
-            }
+            draw_filled_span(triangle, origin_x, origin_y, y, x_start, x_end);
         }
     }
 
@@ -201,11 +236,7 @@ void draw_filled_triangle(
             if (x_end < x_start)
                 int_swap(&x_start, &x_end); // Swap if x_start is to the is to the right of x_end
 
-            for (int x = x_start; x < x_end; x++)
-            {
-                // Draw pixel with a solid color
-                draw_triangle_pixel(x, y, color, point_a, point_b, point_c);
-            }
+            draw_filled_span(triangle, origin_x, origin_y, y, x_start, x_end);
         }
     }
 }
@@ -213,61 +244,56 @@ void draw_filled_triangle(
 ////////////////////////////////////////////////////////////////////
 // Draw a Textured pixel at position (x,y) using depth interpolation.
 ////////////////////////////////////////////////////////////////////
-void draw_texel(
-    int x, int y, upng_t *texture,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c,
-    tex2_t a_uv, tex2_t b_uv, tex2_t c_uv)
+static void draw_texel(int x, int y, float reciprocal_w, float u_over_w, float v_over_w,
+                       const texture_t *texture, const texture_rect_t *rect)
 {
-    vec2_t p = {x, y};
-    vec2_t a = vec2_from_vec4(point_a);
-    vec2_t b = vec2_from_vec4(point_b);
-    vec2_t c = vec2_from_vec4(point_c);
-    vec3_t weights = barycentric_weights(a, b, c, p);
-
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    // Variables to store interpoalted values of u,v and 1/w for current pixel
-    float interpolated_u;
-    float interpolated_v;
-    float interpolated_reciprocal_w;
-
-    // Perform the interpolation of u/w and v/w values using barycentric weights and a factor of 1/w
-    interpolated_u = (a_uv.u / point_a.w) * alpha + (b_uv.u / point_b.w) * beta + (c_uv.u / point_c.w) * gamma;
-    interpolated_v = (a_uv.v / point_a.w) * alpha + (b_uv.v / point_b.w) * beta + (c_uv.v / point_c.w) * gamma;
-
-    // Also interpolate value of 1/w for the current pixel.
-    interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
-
-    // Divide back both interpolated u and v by 1/w.
-    interpolated_u /= interpolated_reciprocal_w;
-    interpolated_v /= interpolated_reciprocal_w;
-
-    // Get mesh texture width and height dimensions
-    int texture_width = upng_get_width(texture);
-    int texture_height = upng_get_height(texture);
-
-    // Map the UV coordinate to the full texture width and height
-    int tex_x = abs((int)(interpolated_u * texture_width)) % texture_width;
-    int tex_y = abs((int)(interpolated_v * texture_height)) % texture_height;
-
     // Adjust 1/w so the pixels that are closer to camera have smaller values (0).
     // and pixels further away from camera have bigger values (1)
-    interpolated_reciprocal_w = 1 - interpolated_reciprocal_w;
+    float depth = 1 - reciprocal_w;
+
+    frame_stats.pixels_tested++;
 
     // Only draw pixel if depth value is less than the one previously stored in z-buffer
     // This way, only render this pixel if it is closer to the camera than whatever pixel was there before
-    if (interpolated_reciprocal_w < get_z_buffer_at(x, y))
+    // (the NaN planes of a triangle without area fail here, before the texel is mapped)
+    if (depth < get_z_buffer_at(x, y))
     {
-        // Get the buffer of colors from the texture
-        uint32_t *texture_buffer = (uint32_t *)(upng_get_buffer(texture));
+        // u/w, v/w and 1/w are linear in screen space; dividing back by 1/w
+        // gives the perspective correct u and v
+        float interpolated_u = u_over_w / reciprocal_w;
+        float interpolated_v = v_over_w / reciprocal_w;
+
+        // Map the UV coordinate to the texture's rectangle, wrapping inside it
+        int tex_x = rect->x + abs((int)(interpolated_u * rect->width)) % rect->width;
+        int tex_y = rect->y + abs((int)(interpolated_v * rect->height)) % rect->height;
 
         // Draw a pixel at position (x,y) with the color obtained from the mapped texture
-        draw_pixel(x, y, texture_buffer[(tex_y * texture_width) + tex_x]);
+        draw_pixel(x, y, get_texel(texture, tex_x, tex_y));
 
         // Update the z-buffer value with 1/w of the current pixel
-        update_z_buffer_at(x, y, interpolated_reciprocal_w);
+        update_z_buffer_at(x, y, depth);
+
+        frame_stats.pixels_written++;
+    }
+    else
+    {
+        frame_stats.pixels_depth_rejected++;
+    }
+}
+
+// Texture the pixels from x_start up to x_end, stepping every plane by its dx
+static void draw_textured_span(const raster_triangle_t *triangle, float origin_x, float origin_y, int y, int x_start, int x_end,
+                               const texture_t *texture, const texture_rect_t *rect)
+{
+    float reciprocal_w = get_plane_value(triangle->reciprocal_w, origin_x, origin_y, x_start, y);
+    float u_over_w = get_plane_value(triangle->u_over_w, origin_x, origin_y, x_start, y);
+    float v_over_w = get_plane_value(triangle->v_over_w, origin_x, origin_y, x_start, y);
+    for (int x = x_start; x < x_end; x++)
+    {
+        draw_texel(x, y, reciprocal_w, u_over_w, v_over_w, texture, rect);
+        reciprocal_w += triangle->reciprocal_w.dx;
+        u_over_w += triangle->u_over_w.dx;
+        v_over_w += triangle->v_over_w.dx;
     }
 }
 
@@ -289,58 +315,77 @@ void draw_texel(
 //                           v2
 //
 ////////////////////////////////////////////////////////////////////
-void draw_textured_triangle(
-    int x0, int y0, float z0, float w0, float u0, float v0,
-    int x1, int y1, float z1, float w1, float u1, float v1,
-    int x2, int y2, float z2, float w2, float u2, float v2,
-    upng_t *texture)
+void draw_textured_triangle(const raster_triangle_t *triangle, const texture_t *texture, const texture_rect_t *rect)
 {
-    // Sort the vertices by ascending Y coordinates y0 < y1 < y2
-    if (y0 > y1)
-    {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-        float_swap(&u0, &u1);
-        float_swap(&v0, &v1);
-    }
-    if (y1 > y2)
+    int x[3], y[3];
+    sort_raster_vertices(triangle, x, y);
+    int x0 = x[0], y0 = y[0], x1 = x[1], y1 = y[1], x2 = x[2], y2 = y[2];
+
+    float origin_x, origin_y;
+    get_raster_origin(triangle, &origin_x, &origin_y);
+
+    ///////////////////////////////////////////////////////
+    // Render the upper part of the triangle (flat-bottom)
+    ///////////////////////////////////////////////////////
+    float inverse_slope_1 = 0;
+    float inverse_slope_2 = 0;
+
+    if (y1 - y0 != 0)
+        inverse_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
+    if (y2 - y0 != 0)
+        inverse_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
+
+    if (y1 - y0 != 0)
     {
-        int_swap(&y1, &y2);
-        int_swap(&x1, &x2);
-        float_swap(&z1, &z2);
-        float_swap(&w1, &w2);
-        float_swap(&u1, &u2);
-        float_swap(&v1, &v2);
+        for (int y = y0; y <= y1; y++)
+        {
+            int x_start = x1 + (y - y1) * inverse_slope_1;
+            int x_end = x0 + (y - y0) * inverse_slope_2;
+
+            if (x_end < x_start)
+                int_swap(&x_start, &x_end); // Swap if x_start is to the is to the right of x_end
+
+            draw_textured_span(triangle, origin_x, origin_y, y, x_start, x_end, texture, rect);
+        }
     }
-    if (y0 > y1)
+
+    ///////////////////////////////////////////////////////
+    // Render the lower part of the triangle (flat-top)
+    ///////////////////////////////////////////////////////
+    inverse_slope_1 = 0;
+    inverse_slope_2 = 0;
+
+    if (y2 - y1 != 0)
+        inverse_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
+    if (y2 - y1 != 0)
+        inverse_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
+
+    if (y2 - y1 != 0)
     {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-        float_swap(&u0, &u1);
-        float_swap(&v0, &v1);
-    }
+        for (int y = y1; y <= y2; y++)
+        {
+            int x_start = x1 + (y - y1) * inverse_slope_1;
+            int x_end = x0 + (y - y0) * inverse_slope_2;
 
-    // Flip the V component to account for inverted UV-coordinates.
-    // V grows downwards, (origin from top-left)
-    v0 = 1 - v0;
-    v1 = 1 - v1;
-    v2 = 1 - v2;
+            if (x_end < x_start)
+                int_swap(&x_start, &x_end); // Swap if x_start is to the is to the right of x_end
 
-    // Create vector points after sorting the vertices
-    vec4_t point_a = {x0, y0, z0, w0};
-    vec4_t point_b = {x1, y1, z1, w1};
-    vec4_t point_c = {x2, y2, z2, w2};
-    tex2_t a_uv = {u0, v0};
-    tex2_t b_uv = {u1, v1};
-    tex2_t c_uv = {u2, v2};
+            draw_textured_span(triangle, origin_x, origin_y, y, x_start, x_end, texture, rect);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Walk the same flat-bottom/flat-top spans as draw_filled_triangle,
+// but only count the coverage of every pixel in the overdraw buffer.
+////////////////////////////////////////////////////////////////////
+void draw_overdraw_triangle(const raster_triangle_t *triangle)
+{
+    int x[3], y[3];
+    sort_raster_vertices(triangle, x, y);
+    int x0 = x[0], y0 = y[0], x1 = x[1], y1 = y[1], x2 = x[2], y2 = y[2];
 
-    ///////////////////////////////////////////////////////
     // Render the upper part of the triangle (flat-bottom)
-    ///////////////////////////////////////////////////////
     float inverse_slope_1 = 0;
     float inverse_slope_2 = 0;
 
@@ -357,21 +402,17 @@ void draw_textured_triangle(
             int x_end = x0 + (y - y0) * inverse_slope_2;
 
             if (x_end < x_start)
-                int_swap(&x_start, &x_end); // Swap if x_start is to the is to the right of x_end
+                int_swap(&x_start, &x_end);
 
             for (int x = x_start; x < x_end; x++)
             {
-                draw_texel(
-                    x, y, texture,
-                    point_a, point_b, point_c,
-                    a_uv, b_uv, c_uv);
+                increment_overdraw_at(x, y);
+                frame_stats.pixels_tested++;
             }
         }
     }
 
-    ///////////////////////////////////////////////////////
     // Render the lower part of the triangle (flat-top)
-    ///////////////////////////////////////////////////////
     inverse_slope_1 = 0;
     inverse_slope_2 = 0;
 
@@ -388,15 +429,99 @@ void draw_textured_triangle(
             int x_end = x0 + (y - y0) * inverse_slope_2;
 
             if (x_end < x_start)
-                int_swap(&x_start, &x_end); // Swap if x_start is to the is to the right of x_end
+                int_swap(&x_start, &x_end);
 
             for (int x = x_start; x < x_end; x++)
             {
-                draw_texel(
-                    x, y, texture,
-                    point_a, point_b, point_c,
-                    a_uv, b_uv, c_uv);
+                increment_overdraw_at(x, y);
+                frame_stats.pixels_tested++;
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Depth-only triangle rasterizer based on edge functions. Every pixel
+// whose center is inside the triangle (edges included) stores
+// 1 - 1/w when it is closer than the value already in the buffer, the
+// same depth convention as the z-buffer. Rows are processed four
+// pixels at a time with SSE2 when available, so the buffer width must
+// be a multiple of 4.
+////////////////////////////////////////////////////////////////////
+void draw_depth_triangle(float *depth_buffer, int width, int height, vec4_t a, vec4_t b, vec4_t c)
+{
+    // Twice the signed area, flip the winding so the edge functions are positive inside
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0)
+        return;
+    if (area < 0)
+    {
+        vec4_t t = b;
+        b = c;
+        c = t;
+        area = -area;
+    }
+
+    int min_x = (int)floorf(fminf(a.x, fminf(b.x, c.x)));
+    int max_x = (int)ceilf(fmaxf(a.x, fmaxf(b.x, c.x)));
+    int min_y = (int)floorf(fminf(a.y, fminf(b.y, c.y)));
+    int max_y = (int)ceilf(fmaxf(a.y, fmaxf(b.y, c.y)));
+    min_x = min_x < 0 ? 0 : min_x & ~3;
+    min_y = min_y < 0 ? 0 : min_y;
+    max_x = max_x > width - 1 ? width - 1 : max_x;
+    max_y = max_y > height - 1 ? height - 1 : max_y;
+    if (min_x > max_x || min_y > max_y)
+        return;
+
+    // Edge function e(x, y) = ex * x + ey * y + e0, one per edge opposite each vertex
+    float e_x[3] = {b.y - c.y, c.y - a.y, a.y - b.y};
+    float e_y[3] = {c.x - b.x, a.x - c.x, b.x - a.x};
+    float e_0[3] = {b.x * c.y - b.y * c.x, c.x * a.y - c.y * a.x, a.x * b.y - a.y * b.x};
+
+    // 1/w is linear in screen space, scale the weights by 1/area up front
+    float inv_w[3] = {1 / (a.w * area), 1 / (b.w * area), 1 / (c.w * area)};
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        float py = y + 0.5f;
+        float *row = &depth_buffer[y * width];
+        int x = min_x;
+
+#if defined(__SSE2__)
+        __m128 zero = _mm_setzero_ps();
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        for (; x <= max_x; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+            __m128 reciprocal_w = zero;
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int i = 0; i < 3; i++)
+            {
+                __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e_x[i]), px), _mm_set1_ps(e_y[i] * py + e_0[i]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(e, zero));
+                reciprocal_w = _mm_add_ps(reciprocal_w, _mm_mul_ps(e, _mm_set1_ps(inv_w[i])));
             }
+
+            __m128 depth = _mm_sub_ps(one, reciprocal_w);
+            __m128 previous = _mm_loadu_ps(&row[x]);
+            __m128 closer = _mm_and_ps(inside, _mm_cmplt_ps(depth, previous));
+            _mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(closer, depth), _mm_andnot_ps(closer, previous)));
+        }
+#endif
+
+        for (; x <= max_x; x++)
+        {
+            float px = x + 0.5f;
+            float e0 = e_x[0] * px + e_y[0] * py + e_0[0];
+            float e1 = e_x[1] * px + e_y[1] * py + e_0[1];
+            float e2 = e_x[2] * px + e_y[2] * py + e_0[2];
+            if (e0 < 0 || e1 < 0 || e2 < 0)
+                continue;
+
+            float depth = 1 - (e0 * inv_w[0] + e1 * inv_w[1] + e2 * inv_w[2]);
+            if (depth < row[x])
+                row[x] = depth;
         }
     }
-}
\ No newline at end of file
+}
@@ -4,45 +4,99 @@
 #include <stdint.h>
 #include "vector.h"
 #include "texture.h"
-#include "upng.h"
+
+////////////////////////////////////////////////////////////////////
+// A mesh vertex is a unique combination of the position and texture
+// coordinate its faces use at that corner; faces index vertices, so a
+// corner costs a single int. Shading uses face normals, so the OBJ
+// vertex normals are not kept and do not split vertices.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    vec3_t position;
+    tex2_t uv;
+} vertex_t;
+
+////////////////////////////////////////////////////////////////////
+// Compressed vertex: position and uv as 16-bit fractions of the mesh
+// bounds and uv range.
+////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    uint16_t position[3];
+    uint16_t uv[2];
+} quantized_vertex_t;
 
 typedef struct
 {
     int a;
     int b;
     int c;
-    tex2_t a_uv;
-    tex2_t b_uv;
-    tex2_t c_uv;
     uint32_t color;
 } face_t;
 
+// Triangle coming out of the clipping stage, in camera space
 typedef struct
 {
     vec4_t points[3];
     tex2_t texcoords[3];
-    uint32_t color;
-    upng_t *texture;
 } triangle_t;
 
-void draw_triangle_pixel(int x, int y, uint32_t color, vec4_t a, vec4_t b, vec4_t c);
+////////////////////////////////////////////////////////////////////
+// Screen space triangle handed from the geometry stage to the raster
+// stage. Vertex positions are fixed point with RASTER_SUBPIXEL_BITS
+// fractional bits; the rasterizer walks the spans between them snapped
+// to whole pixels, as it always has. Depth (1/w) and the perspective
+// correct texture coordinates (u/w and v/w) are linear in screen
+// space, so each is stored as the plane it spans rather than per
+// vertex: value + dx * (x - x0) + dy * (y - y0), fitted at the subpixel
+// positions with (x0, y0) the position of vertex 0, which all three
+// planes share. The rasterizer evaluates the planes once at the center
+// of the first pixel of each span and steps them by dx from there.
+////////////////////////////////////////////////////////////////////
+#define RASTER_SUBPIXEL_BITS 4
+#define RASTER_SUBPIXEL_SCALE (1 << RASTER_SUBPIXEL_BITS)
+
+typedef struct
+{
+    float value; // At vertex 0 (x[0], y[0] of the triangle)
+    float dx;
+    float dy;
+} raster_plane_t;
+
+typedef struct
+{
+    int32_t x[3];                // Fixed point, in the winding order of the face
+    int32_t y[3];
+    raster_plane_t reciprocal_w; // Depth plane
+    raster_plane_t u_over_w;
+    raster_plane_t v_over_w;     // V flipped to grow downwards in the texture
+    uint32_t color;
+    int16_t texture;             // Table slot of the texels sampled, -1 when flat shaded
+    int16_t texture_rect;        // Table slot of the mesh texture, whose rectangle the uv wraps in
+} raster_triangle_t;
+
+// Whole pixel of a fixed point coordinate, truncated toward zero
+static inline int get_raster_pixel(int32_t coordinate)
+{
+    return coordinate / RASTER_SUBPIXEL_SCALE;
+}
+
+// Convert projected screen space points (x, y in pixels, w the view space
+// depth) and fit the planes of the raster stage
+void setup_raster_triangle(
+    raster_triangle_t *triangle, const vec4_t points[3], const tex2_t texcoords[3],
+    uint32_t color, const texture_t *texture);
+
+void draw_filled_triangle(const raster_triangle_t *triangle);
 
-void draw_filled_triangle(
-    int x0, int y0, float z0, float w0,
-    int x1, int y1, float z1, float w1,
-    int x2, int y2, float z2, float w2,
-    uint32_t color);
+void draw_textured_triangle(const raster_triangle_t *triangle, const texture_t *texture, const texture_rect_t *rect);
 
-void draw_textured_triangle(
-    int x0, int y0, float z0, float w0, float u0, float v0,
-    int x1, int y1, float z1, float w1, float u1, float v1,
-    int x2, int y2, float z2, float w2, float u2, float v2,
-    upng_t *texture);
+void draw_overdraw_triangle(const raster_triangle_t *triangle);
 
-void draw_texel(
-    int x, int y, upng_t *texture,
-    vec4_t a, vec4_t b, vec4_t c,
-    tex2_t a_uv, tex2_t b_uv, tex2_t c_uv);
+// Depth-only rasterization of a screen space triangle (x, y in pixels of
+// the target buffer, w the view space depth) into an arbitrary buffer
+void draw_depth_triangle(float *depth_buffer, int width, int height, vec4_t a, vec4_t b, vec4_t c);
 
 vec3_t get_triangle_normal(vec4_t vertices[3]);
 
@@ -24,10 +24,23 @@ freely, subject to the following restrictions:
         distribution.
 */
 
+#define _XOPEN_SOURCE 700 /* mmap, fstat */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define UPNG_SSSE3_DISPATCH 1 /* SSSE3 kernels are compiled in and chosen at runtime */
+#endif
 
 #include "upng.h"
 
@@ -56,6 +69,9 @@ freely, subject to the following restrictions:
 #define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
 #define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
 
+#define UZ_WINDOW_SIZE 32768 /* largest back reference distance allowed by deflate */
+#define UZ_WINDOW_MASK (UZ_WINDOW_SIZE - 1)
+
 #define SET_ERROR(upng, code)          \
     do                                 \
     {                                  \
@@ -83,6 +99,13 @@ typedef enum upng_color
     UPNG_RGBA = 6
 } upng_color;
 
+typedef enum upng_owning
+{
+    UPNG_BORROWED = 0, /* caller owns the bytes */
+    UPNG_ALLOCATED = 1, /* read into a malloc'd buffer */
+    UPNG_MAPPED = 2     /* read-only mapping of the file */
+} upng_owning;
+
 typedef struct upng_source
 {
     const unsigned char *buffer;
@@ -101,6 +124,8 @@ struct upng_t
 
     unsigned char *buffer;
     unsigned long size;
+    void *mapping;              /* file mapping holding buffer, NULL when buffer is malloc'd */
+    unsigned long mapping_size;
 
     upng_error error;
     unsigned error_line;
@@ -116,6 +141,48 @@ typedef struct huffman_tree
     unsigned numcodes;  /*number of symbols in the alphabet = number of codes */
 } huffman_tree;
 
+#if defined(__SSE2__)
+typedef void (*unfilter4_kernel)(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length);
+#endif
+
+/* inflated bytes are not kept for the whole image: they go into a sliding
+ * window for back references and into the current filtered scanline, which
+ * is unfiltered into the final image buffer as soon as it is complete */
+typedef struct uz_stream
+{
+    unsigned char window[UZ_WINDOW_SIZE];
+    unsigned long pos; /*total number of bytes inflated so far */
+
+    unsigned char *line;     /*filter type byte followed by the filtered scanline */
+    unsigned long linepos;   /*bytes of the current scanline received so far */
+    unsigned long linebytes; /*bytes of a scanline without its filter type byte */
+    unsigned long bytewidth; /*distance to the corresponding byte of the previous pixel */
+    unsigned row;            /*index of the scanline being received */
+
+    unsigned char *out;      /*final image buffer */
+    unsigned char *recon[2]; /*unfiltered current and previous scanlines when they cannot live in out */
+    unsigned char *prevline; /*previous unfiltered scanline, NULL for the first one */
+
+#if defined(__SSE2__)
+    unfilter4_kernel unfilter4[5]; /*vector kernel of each filter type for 4 byte pixels, NULL for the scalar path */
+#endif
+} uz_stream;
+
+static void emit_scanline(upng_t *upng, uz_stream *stream);
+
+/* append one inflated byte to the window and the current scanline */
+static void uz_emit(upng_t *upng, uz_stream *stream, unsigned char byte)
+{
+    stream->window[stream->pos & UZ_WINDOW_MASK] = byte;
+    stream->pos++;
+
+    stream->line[stream->linepos++] = byte;
+    if (stream->linepos == stream->linebytes + 1)
+    {
+        emit_scanline(upng, stream);
+    }
+}
+
 static const unsigned LENGTH_BASE[29] = {/*the base lengths represented by codes 257-285 */
                                          3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
                                          67, 83, 99, 115, 131, 163, 195, 227, 258};
@@ -390,12 +457,12 @@ static void get_tree_inflate_dynamic(upng_t *upng, huffman_tree *codetree, huffm
             unsigned replength = 3; /*read in the 2 bits that indicate repeat length (3-6) */
             unsigned value;         /*set value to the previous code */
 
-            if ((*bp) >> 3 >= inlength)
+            /* there is no previous length to repeat before the first one, or the bit pointer jumps past memory */
+            if (i == 0 || (*bp) >> 3 >= inlength)
             {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 break;
             }
-            /*error, bit pointer jumps past memory */
             replength += read_bits(bp, in, 2);
 
             if ((i - 1) < hlit)
@@ -515,7 +582,7 @@ static void get_tree_inflate_dynamic(upng_t *upng, huffman_tree *codetree, huffm
 }
 
 /*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t *upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+static void inflate_huffman(upng_t *upng, uz_stream *stream, const unsigned char *in, unsigned long *bp, unsigned long inlength, unsigned btype)
 {
     unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
     unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
@@ -558,21 +625,14 @@ static void inflate_huffman(upng_t *upng, unsigned char *out, unsigned long outs
         else if (code <= 255)
         {
             /* literal symbol */
-            if ((*pos) >= outsize)
-            {
-                SET_ERROR(upng, UPNG_EMALFORMED);
-                return;
-            }
-
-            /* store output */
-            out[(*pos)++] = (unsigned char)(code);
+            uz_emit(upng, stream, (unsigned char)(code));
         }
         else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX)
         { /*length code */
             /* part 1: get length base */
             unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
             unsigned codeD, distance, numextrabitsD;
-            unsigned long start, forward, backward, numextrabits;
+            unsigned long forward, numextrabits;
 
             /* part 2: get extra bits and add the value of that to length */
             numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
@@ -613,11 +673,8 @@ static void inflate_huffman(upng_t *upng, unsigned char *out, unsigned long outs
 
             distance += read_bits(bp, in, numextrabitsD);
 
-            /*part 5: fill in all the out[n] values based on the length and dist */
-            start = (*pos);
-            backward = start - distance;
-
-            if ((*pos) + length >= outsize)
+            /*part 5: copy length bytes starting distance bytes back; the copy may overlap itself */
+            if (distance > stream->pos)
             {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return;
@@ -625,19 +682,13 @@ static void inflate_huffman(upng_t *upng, unsigned char *out, unsigned long outs
 
             for (forward = 0; forward < length; forward++)
             {
-                out[(*pos)++] = out[backward];
-                backward++;
-
-                if (backward >= start)
-                {
-                    backward = start - distance;
-                }
+                uz_emit(upng, stream, stream->window[(stream->pos - distance) & UZ_WINDOW_MASK]);
             }
         }
     }
 }
 
-static void inflate_uncompressed(upng_t *upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t *upng, uz_stream *stream, const unsigned char *in, unsigned long *bp, unsigned long inlength)
 {
     unsigned long p;
     unsigned len, nlen, n;
@@ -668,12 +719,6 @@ static void inflate_uncompressed(upng_t *upng, unsigned char *out, unsigned long
         return;
     }
 
-    if ((*pos) + len >= outsize)
-    {
-        SET_ERROR(upng, UPNG_EMALFORMED);
-        return;
-    }
-
     /* read the literal data: len bytes are now stored in the out buffer */
     if (p + len > inlength)
     {
@@ -683,17 +728,16 @@ static void inflate_uncompressed(upng_t *upng, unsigned char *out, unsigned long
 
     for (n = 0; n < len; n++)
     {
-        out[(*pos)++] = in[p++];
+        uz_emit(upng, stream, in[p++]);
     }
 
     (*bp) = p * 8;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
-static upng_error uz_inflate_data(upng_t *upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
+static upng_error uz_inflate_data(upng_t *upng, uz_stream *stream, const unsigned char *in, unsigned long insize, unsigned long inpos)
 {
-    unsigned long bp = 0;  /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
-    unsigned long pos = 0; /*byte position in the out buffer */
+    unsigned long bp = 0; /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
 
     unsigned done = 0;
 
@@ -710,7 +754,7 @@ static upng_error uz_inflate_data(upng_t *upng, unsigned char *out, unsigned lon
 
         /* read block control bits */
         done = read_bit(&bp, &in[inpos]);
-        btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
+        btype = read_bits(&bp, &in[inpos], 2); /* both bits in one call, the operands of | may be evaluated in either order */
 
         /* process control type appropriateyly */
         if (btype == 3)
@@ -720,11 +764,11 @@ static upng_error uz_inflate_data(upng_t *upng, unsigned char *out, unsigned lon
         }
         else if (btype == 0)
         {
-            inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize); /*no compression */
+            inflate_uncompressed(upng, stream, &in[inpos], &bp, insize); /*no compression */
         }
         else
         {
-            inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype); /*compression, btype 01 or 10 */
+            inflate_huffman(upng, stream, &in[inpos], &bp, insize, btype); /*compression, btype 01 or 10 */
         }
 
         /* stop if an error has occured */
@@ -737,7 +781,7 @@ static upng_error uz_inflate_data(upng_t *upng, unsigned char *out, unsigned lon
     return upng->error;
 }
 
-static upng_error uz_inflate(upng_t *upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long insize)
+static upng_error uz_inflate(upng_t *upng, uz_stream *stream, const unsigned char *in, unsigned long insize)
 {
     /* we require two bytes for the zlib data header */
     if (insize < 2)
@@ -767,8 +811,8 @@ static upng_error uz_inflate(upng_t *upng, unsigned char *out, unsigned long out
         return upng->error;
     }
 
-    /* create output buffer */
-    uz_inflate_data(upng, out, outsize, in, insize, 2);
+    /* inflate into the scanline stream */
+    uz_inflate_data(upng, stream, in, insize, 2);
 
     return upng->error;
 }
@@ -789,7 +833,148 @@ static int paeth_predictor(int a, int b, int c)
         return c;
 }
 
-static void unfilter_scanline(upng_t *upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+#if defined(__SSE2__)
+/*
+   Vectorized unfilter kernels for 4 bytes per pixel (8 bit RGBA, 16 bit grey with alpha) with a previous scanline.
+   Up works on 16 bytes at a time; Sub does a prefix sum over the 4 pixels of a register; Average and Paeth depend on
+   the pixel to their left so they carry it in a register and work one pixel at a time, branch free.
+   length is a multiple of 4.
+ */
+static __m128i load_pixel4(const unsigned char *p)
+{
+    int value;
+    memcpy(&value, p, 4);
+    return _mm_cvtsi32_si128(value);
+}
+
+static void store_pixel4(unsigned char *p, __m128i v)
+{
+    int value = _mm_cvtsi128_si32(v);
+    memcpy(p, &value, 4);
+}
+
+static void unfilter_sub4_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+    unsigned long i = 0;
+    __m128i a = _mm_setzero_si128(); /*last reconstructed pixel, in the low 4 bytes*/
+    (void)precon;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(scanline + i));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi8(x, a);
+        _mm_storeu_si128((__m128i *)(recon + i), x);
+        a = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    for (; i < length; i += 4)
+    {
+        a = _mm_add_epi8(load_pixel4(scanline + i), a);
+        store_pixel4(recon + i, a);
+    }
+}
+
+static void unfilter_up4_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+    unsigned long i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(scanline + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(precon + i));
+        _mm_storeu_si128((__m128i *)(recon + i), _mm_add_epi8(x, b));
+    }
+    for (; i < length; i++)
+        recon[i] = scanline[i] + precon[i];
+}
+
+static void unfilter_avg4_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+    unsigned long i;
+    __m128i one = _mm_set1_epi8(1);
+    __m128i a = _mm_setzero_si128();
+    for (i = 0; i < length; i += 4)
+    {
+        __m128i b = load_pixel4(precon + i);
+        /* _mm_avg_epu8 rounds up; subtract the carried low bit to get (a + b) / 2 */
+        __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+        a = _mm_add_epi8(load_pixel4(scanline + i), average);
+        store_pixel4(recon + i, a);
+    }
+}
+
+/* pick a, b or c for one pixel widened to 16 bits, given the distances of each from the Paeth estimate */
+static __m128i paeth_select4(__m128i a, __m128i b, __m128i c, __m128i pa, __m128i pb, __m128i pc)
+{
+    __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    __m128i use_a = _mm_cmpeq_epi16(pa, smallest);
+    __m128i use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(pb, smallest));
+    __m128i use_c = _mm_andnot_si128(_mm_or_si128(use_a, use_b), _mm_set1_epi16(-1));
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(use_a, a), _mm_and_si128(use_b, b)), _mm_and_si128(use_c, c));
+}
+
+static void unfilter_paeth4_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+    unsigned long i;
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = zero, c = zero; /*left and upper left pixels, widened to 16 bits*/
+    for (i = 0; i < length; i += 4)
+    {
+        __m128i b = _mm_unpacklo_epi8(load_pixel4(precon + i), zero);
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_add_epi16(pa, pb);
+        /* no 16 bit absolute value before SSSE3: max(x, -x) */
+        pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+        pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+        pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+        __m128i x = _mm_add_epi8(load_pixel4(scanline + i), _mm_packus_epi16(paeth_select4(a, b, c, pa, pb, pc), zero));
+        store_pixel4(recon + i, x);
+        a = _mm_unpacklo_epi8(x, zero);
+        c = b;
+    }
+}
+
+#if defined(UPNG_SSSE3_DISPATCH)
+__attribute__((target("ssse3"))) static void unfilter_paeth4_ssse3(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+    unsigned long i;
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = zero, c = zero;
+    for (i = 0; i < length; i += 4)
+    {
+        __m128i b = _mm_unpacklo_epi8(load_pixel4(precon + i), zero);
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+        pa = _mm_abs_epi16(pa);
+        pb = _mm_abs_epi16(pb);
+
+        __m128i x = _mm_add_epi8(load_pixel4(scanline + i), _mm_packus_epi16(paeth_select4(a, b, c, pa, pb, pc), zero));
+        store_pixel4(recon + i, x);
+        a = _mm_unpacklo_epi8(x, zero);
+        c = b;
+    }
+}
+#endif
+
+/*pick the kernel of every filter type once per image, Paeth with SSSE3 when the CPU has it*/
+static void select_unfilter4_kernels(unfilter4_kernel kernels[5])
+{
+    kernels[0] = NULL;
+    kernels[1] = unfilter_sub4_sse2;
+    kernels[2] = unfilter_up4_sse2;
+    kernels[3] = unfilter_avg4_sse2;
+    kernels[4] = unfilter_paeth4_sse2;
+#if defined(UPNG_SSSE3_DISPATCH)
+    if (__builtin_cpu_supports("ssse3"))
+        kernels[4] = unfilter_paeth4_ssse3;
+#endif
+}
+#endif
+
+static void unfilter_scanline(upng_t *upng, const uz_stream *stream, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
 {
     /*
        For PNG filter method 0
@@ -800,6 +985,16 @@ static void unfilter_scanline(upng_t *upng, unsigned char *recon, const unsigned
      */
 
     unsigned long i;
+
+#if defined(__SSE2__)
+    /* every row but the first of a 4 byte per pixel image goes through the vector kernels */
+    if (bytewidth == 4 && precon != NULL && filterType <= 4 && stream->unfilter4[filterType] != NULL)
+    {
+        stream->unfilter4[filterType](recon, scanline, precon, length);
+        return;
+    }
+#endif
+
     switch (filterType)
     {
     case 0:
@@ -858,93 +1053,57 @@ static void unfilter_scanline(upng_t *upng, unsigned char *recon, const unsigned
     }
 }
 
-static void unfilter(upng_t *upng, unsigned char *out, const unsigned char *in, unsigned w, unsigned h, unsigned bpp)
+static void remove_padding_bits(unsigned char *out, unsigned long obp, const unsigned char *in, unsigned long olinebits)
 {
     /*
-       For PNG filter method 0
-       this function unfilters a single image (e.g. without interlacing this is called once, with Adam7 it's called 7 times)
-       out must have enough bytes allocated already, in must have the scanlines + 1 filtertype byte per scanline
-       w and h are image dimensions or dimensions of reduced image, bpp is bpp per pixel
-       in and out are allowed to be the same memory address!
+       After filtering there are still padding bits if scanlines have non multiple of 8 bit amounts. They need to be removed before working with pure image buffers.
+       copies the first olinebits bits of the scanline in to out, starting at bit obp of out
      */
-
-    unsigned y;
-    unsigned char *prevline = 0;
-
-    unsigned long bytewidth = (bpp + 7) / 8; /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
-    unsigned long linebytes = (w * bpp + 7) / 8;
-
-    for (y = 0; y < h; y++)
+    unsigned long ibp = 0; /*bit pointer */
+    unsigned long x;
+    for (x = 0; x < olinebits; x++)
     {
-        unsigned long outindex = linebytes * y;
-        unsigned long inindex = (1 + linebytes) * y; /*the extra filterbyte added to each row */
-        unsigned char filterType = in[inindex];
-
-        unfilter_scanline(upng, &out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes);
-        if (upng->error != UPNG_EOK)
-        {
-            return;
-        }
+        unsigned char bit = (unsigned char)((in[(ibp) >> 3] >> (7 - ((ibp)&0x7))) & 1);
+        ibp++;
 
-        prevline = &out[outindex];
+        if (bit == 0)
+            out[(obp) >> 3] &= (unsigned char)(~(1 << (7 - ((obp)&0x7))));
+        else
+            out[(obp) >> 3] |= (1 << (7 - ((obp)&0x7)));
+        ++obp;
     }
 }
 
-static void remove_padding_bits(unsigned char *out, const unsigned char *in, unsigned long olinebits, unsigned long ilinebits, unsigned h)
+/*unfilter the scanline that was just completed and store it in the final image buffer*/
+static void emit_scanline(upng_t *upng, uz_stream *stream)
 {
-    /*
-       After filtering there are still padding bpp if scanlines have non multiple of 8 bit amounts. They need to be removed (except at last scanline of (Adam7-reduced) image) before working with pure image buffers for the Adam7 code, the color convert code and the output to the user.
-       in and out are allowed to be the same buffer, in may also be higher but still overlapping; in must have >= ilinebits*h bpp, out must have >= olinebits*h bpp, olinebits must be <= ilinebits
-       also used to move bpp after earlier such operations happened, e.g. in a sequence of reduced images from Adam7
-       only useful if (ilinebits - olinebits) is a value in the range 1..7
-     */
-    unsigned y;
-    unsigned long diff = ilinebits - olinebits;
-    unsigned long obp = 0, ibp = 0; /*bit pointers */
-    for (y = 0; y < h; y++)
-    {
-        unsigned long x;
-        for (x = 0; x < olinebits; x++)
-        {
-            unsigned char bit = (unsigned char)((in[(ibp) >> 3] >> (7 - ((ibp)&0x7))) & 1);
-            ibp++;
-
-            if (bit == 0)
-                out[(obp) >> 3] &= (unsigned char)(~(1 << (7 - ((obp)&0x7))));
-            else
-                out[(obp) >> 3] |= (1 << (7 - ((obp)&0x7)));
-            ++obp;
-        }
-        ibp += diff;
-    }
-}
+    unsigned long olinebits = upng->width * upng_get_bpp(upng);
+    unsigned char *recon;
 
-/*out must be buffer big enough to contain full image, and in must contain the full decompressed data from the IDAT chunks*/
-static void post_process_scanlines(upng_t *upng, unsigned char *out, unsigned char *in, const upng_t *info_png)
-{
-    unsigned bpp = upng_get_bpp(info_png);
-    unsigned w = info_png->width;
-    unsigned h = info_png->height;
+    stream->linepos = 0;
 
-    if (bpp == 0)
+    /* data past the last scanline is ignored */
+    if (stream->row >= upng->height || upng->error != UPNG_EOK)
     {
-        SET_ERROR(upng, UPNG_EMALFORMED);
         return;
     }
 
-    if (bpp < 8 && w * bpp != ((w * bpp + 7) / 8) * 8)
+    if (stream->recon[0] == NULL)
     {
-        unfilter(upng, in, in, w, h, bpp);
-        if (upng->error != UPNG_EOK)
-        {
-            return;
-        }
-        remove_padding_bits(out, in, w * bpp, ((w * bpp + 7) / 8) * 8, h);
+        /* whole bytes per scanline: unfilter straight into the image, the previous row is already there */
+        recon = stream->out + stream->linebytes * stream->row;
+        unfilter_scanline(upng, stream, recon, stream->line + 1, stream->prevline, stream->bytewidth, stream->line[0], stream->linebytes);
     }
     else
     {
-        unfilter(upng, out, in, w, h, bpp); /*we can immediatly filter into the out buffer, no other steps needed */
+        /* padded scanlines alternate between two row buffers, then lose their padding bits */
+        recon = stream->recon[stream->row & 1];
+        unfilter_scanline(upng, stream, recon, stream->line + 1, stream->prevline, stream->bytewidth, stream->line[0], stream->linebytes);
+        remove_padding_bits(stream->out, olinebits * stream->row, recon, olinebits);
     }
+
+    stream->prevline = recon;
+    stream->row++;
 }
 
 static upng_format determine_format(upng_t *upng)
@@ -1006,14 +1165,18 @@ static upng_format determine_format(upng_t *upng)
 
 static void upng_free_source(upng_t *upng)
 {
-    if (upng->source.owning != 0)
+    if (upng->source.owning == UPNG_ALLOCATED)
     {
         free((void *)upng->source.buffer);
     }
+    else if (upng->source.owning == UPNG_MAPPED)
+    {
+        munmap((void *)upng->source.buffer, upng->source.size);
+    }
 
     upng->source.buffer = NULL;
     upng->source.size = 0;
-    upng->source.owning = 0;
+    upng->source.owning = UPNG_BORROWED;
 }
 
 /*read the information from the header and store it in the upng_Info. return value is error*/
@@ -1097,11 +1260,12 @@ upng_error upng_header(upng_t *upng)
 upng_error upng_decode(upng_t *upng)
 {
     const unsigned char *chunk;
-    unsigned char *compressed;
-    unsigned char *inflated;
+    const unsigned char *compressed = NULL;
+    unsigned char *concatenated = NULL;
     unsigned long compressed_size = 0, compressed_index = 0;
-    unsigned long inflated_size;
-    upng_error error;
+    unsigned num_idat = 0;
+    unsigned bpp;
+    uz_stream *stream;
 
     /* if we have an error state, bail now */
     if (upng->error != UPNG_EOK)
@@ -1168,7 +1332,10 @@ upng_error upng_decode(upng_t *upng)
         /* parse chunks */
         if (upng_chunk_type(chunk) == CHUNK_IDAT)
         {
+            /* remember the payload; with a single IDAT it is inflated in place */
+            compressed = data;
             compressed_size += length;
+            num_idat++;
         }
         else if (upng_chunk_type(chunk) == CHUNK_IEND)
         {
@@ -1183,75 +1350,119 @@ upng_error upng_decode(upng_t *upng)
         chunk += upng_chunk_length(chunk) + 12;
     }
 
-    /* allocate enough space for the (compressed and filtered) image data */
-    compressed = (unsigned char *)malloc(compressed_size);
-    if (compressed == NULL)
+    /* a single IDAT chunk is inflated straight from the source buffer;
+     * several are concatenated into one compressed stream first */
+    if (num_idat == 0)
     {
-        SET_ERROR(upng, UPNG_ENOMEM);
+        SET_ERROR(upng, UPNG_EMALFORMED);
         return upng->error;
     }
-
-    /* scan through the chunks again, this time copying the values into
-     * our compressed buffer.  there's no reason to validate anything a second time. */
-    chunk = upng->source.buffer + 33;
-    while (chunk < upng->source.buffer + upng->source.size)
+    if (num_idat > 1)
     {
-        unsigned long length;
-        const unsigned char *data; /*the data in the chunk */
-
-        length = upng_chunk_length(chunk);
-        data = chunk + 8;
-
-        /* parse chunks */
-        if (upng_chunk_type(chunk) == CHUNK_IDAT)
+        concatenated = (unsigned char *)malloc(compressed_size);
+        if (concatenated == NULL)
         {
-            memcpy(compressed + compressed_index, data, length);
-            compressed_index += length;
+            SET_ERROR(upng, UPNG_ENOMEM);
+            return upng->error;
         }
-        else if (upng_chunk_type(chunk) == CHUNK_IEND)
+
+        /* scan through the chunks again, this time copying the values into
+         * our compressed buffer.  there's no reason to validate anything a second time. */
+        chunk = upng->source.buffer + 33;
+        while (chunk < upng->source.buffer + upng->source.size)
         {
-            break;
-        }
+            unsigned long length;
+            const unsigned char *data; /*the data in the chunk */
 
-        chunk += upng_chunk_length(chunk) + 12;
-    }
+            length = upng_chunk_length(chunk);
+            data = chunk + 8;
 
-    /* allocate space to store inflated (but still filtered) data */
-    inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
-    inflated = (unsigned char *)malloc(inflated_size);
-    if (inflated == NULL)
-    {
-        free(compressed);
-        SET_ERROR(upng, UPNG_ENOMEM);
-        return upng->error;
+            /* parse chunks */
+            if (upng_chunk_type(chunk) == CHUNK_IDAT)
+            {
+                memcpy(concatenated + compressed_index, data, length);
+                compressed_index += length;
+            }
+            else if (upng_chunk_type(chunk) == CHUNK_IEND)
+            {
+                break;
+            }
+
+            chunk += upng_chunk_length(chunk) + 12;
+        }
+        compressed = concatenated;
     }
 
-    /* decompress image data */
-    error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
-    if (error != UPNG_EOK)
+    bpp = upng_get_bpp(upng);
+    if (bpp == 0)
     {
-        free(compressed);
-        free(inflated);
+        free(concatenated);
+        SET_ERROR(upng, UPNG_EMALFORMED);
         return upng->error;
     }
 
-    /* free the compressed compressed data */
-    free(compressed);
-
     /* allocate final image buffer */
-    upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
+    upng->size = (upng->height * upng->width * bpp + 7) / 8;
     upng->buffer = (unsigned char *)malloc(upng->size);
-    if (upng->buffer == NULL)
+    stream = (uz_stream *)malloc(sizeof(uz_stream));
+    if (upng->buffer == NULL || stream == NULL)
     {
-        free(inflated);
+        free(concatenated);
+        free(stream);
+        free(upng->buffer);
+        upng->buffer = NULL;
         upng->size = 0;
         SET_ERROR(upng, UPNG_ENOMEM);
         return upng->error;
     }
 
-    /* unfilter scanlines */
-    post_process_scanlines(upng, upng->buffer, inflated, upng);
-    free(inflated);
+    /* set up the scanline stream; only the scanline being received and the
+     * previous unfiltered one are kept besides the inflate window */
+    stream->pos = 0;
+    stream->linepos = 0;
+    stream->linebytes = (upng->width * bpp + 7) / 8;
+    stream->bytewidth = (bpp + 7) / 8; /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
+    stream->row = 0;
+    stream->out = upng->buffer;
+    stream->recon[0] = stream->recon[1] = NULL;
+    stream->prevline = NULL;
+#if defined(__SSE2__)
+    select_unfilter4_kernels(stream->unfilter4);
+#endif
+    stream->line = (unsigned char *)malloc(stream->linebytes + 1);
+    if (stream->line != NULL && bpp < 8 && upng->width * bpp != stream->linebytes * 8)
+    {
+        /* scanlines with padding bits are unfiltered aside before being packed into the image */
+        stream->recon[0] = (unsigned char *)malloc(stream->linebytes * 2);
+        stream->recon[1] = stream->recon[0] + stream->linebytes;
+        if (stream->recon[0] == NULL)
+        {
+            free(stream->line);
+            stream->line = NULL;
+        }
+    }
+    if (stream->line == NULL)
+    {
+        SET_ERROR(upng, UPNG_ENOMEM);
+    }
+
+    /* decompress and unfilter image data */
+    if (upng->error == UPNG_EOK)
+    {
+        uz_inflate(upng, stream, compressed, compressed_size);
+    }
+
+    /* the zlib stream must cover every scanline */
+    if (upng->error == UPNG_EOK && stream->row < upng->height)
+    {
+        SET_ERROR(upng, UPNG_EMALFORMED);
+    }
+
+    /* free the scanline stream and the concatenated compressed data, if any */
+    free(stream->line);
+    free(stream->recon[0]);
+    free(stream);
+    free(concatenated);
 
     if (upng->error != UPNG_EOK)
     {
@@ -1282,6 +1493,8 @@ static upng_t *upng_new(void)
 
     upng->buffer = NULL;
     upng->size = 0;
+    upng->mapping = NULL;
+    upng->mapping_size = 0;
 
     upng->width = upng->height = 0;
 
@@ -1296,7 +1509,7 @@ static upng_t *upng_new(void)
 
     upng->source.buffer = NULL;
     upng->source.size = 0;
-    upng->source.owning = 0;
+    upng->source.owning = UPNG_BORROWED;
 
     return upng;
 }
@@ -1311,7 +1524,7 @@ upng_t *upng_new_from_bytes(const unsigned char *buffer, unsigned long size)
 
     upng->source.buffer = buffer;
     upng->source.size = size;
-    upng->source.owning = 0;
+    upng->source.owning = UPNG_BORROWED;
 
     return upng;
 }
@@ -1320,8 +1533,9 @@ upng_t *upng_new_from_file(const char *filename)
 {
     upng_t *upng;
     unsigned char *buffer;
-    FILE *file;
-    long size;
+    struct stat info;
+    void *mapping;
+    int file;
 
     upng = upng_new();
     if (upng == NULL)
@@ -1329,33 +1543,84 @@ upng_t *upng_new_from_file(const char *filename)
         return NULL;
     }
 
-    file = fopen(filename, "rb");
-    if (file == NULL)
+    file = open(filename, O_RDONLY);
+    if (file < 0)
     {
         SET_ERROR(upng, UPNG_ENOTFOUND);
         return upng;
     }
 
     /* get filesize */
-    fseek(file, 0, SEEK_END);
-    size = ftell(file);
-    rewind(file);
+    if (fstat(file, &info) != 0 || info.st_size <= 0)
+    {
+        close(file);
+        SET_ERROR(upng, UPNG_ENOTPNG);
+        return upng;
+    }
+
+    /* map the file read-only and decode straight from the page cache; the
+     * mapping stays valid after the descriptor is closed */
+    mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapping != MAP_FAILED)
+    {
+        close(file);
+        posix_madvise(mapping, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+
+        upng->source.buffer = (const unsigned char *)mapping;
+        upng->source.size = (unsigned long)info.st_size;
+        upng->source.owning = UPNG_MAPPED;
+        return upng;
+    }
 
-    /* read contents of the file into the vector */
-    buffer = (unsigned char *)malloc((unsigned long)size);
+    /* files that cannot be mapped are read into a buffer instead */
+    buffer = (unsigned char *)malloc((unsigned long)info.st_size);
     if (buffer == NULL)
     {
-        fclose(file);
+        close(file);
         SET_ERROR(upng, UPNG_ENOMEM);
         return upng;
     }
-    fread(buffer, 1, (unsigned long)size, file);
-    fclose(file);
+    if (read(file, buffer, (size_t)info.st_size) != (ssize_t)info.st_size)
+    {
+        free(buffer);
+        close(file);
+        SET_ERROR(upng, UPNG_ENOTFOUND);
+        return upng;
+    }
+    close(file);
 
     /* set the read buffer as our source buffer, with owning flag set */
     upng->source.buffer = buffer;
-    upng->source.size = size;
-    upng->source.owning = 1;
+    upng->source.size = (unsigned long)info.st_size;
+    upng->source.owning = UPNG_ALLOCATED;
+
+    return upng;
+}
+
+upng_t *upng_new_from_mapped_pixels(void *mapping, unsigned long mapping_size, unsigned long offset, unsigned width, unsigned height)
+{
+    upng_t *upng;
+
+    /* the pixels must fit in the mapping */
+    if (offset + (unsigned long)width * height * 4 > mapping_size)
+    {
+        return NULL;
+    }
+
+    upng = upng_new();
+    if (upng == NULL)
+    {
+        return NULL;
+    }
+
+    /* already decoded 8 bit RGBA, nothing is left to parse */
+    upng->width = width;
+    upng->height = height;
+    upng->buffer = (unsigned char *)mapping + offset;
+    upng->size = (unsigned long)width * height * 4;
+    upng->mapping = mapping;
+    upng->mapping_size = mapping_size;
+    upng->state = UPNG_DECODED;
 
     return upng;
 }
@@ -1363,7 +1628,11 @@ upng_t *upng_new_from_file(const char *filename)
 void upng_free(upng_t *upng)
 {
     /* deallocate image buffer */
-    if (upng->buffer != NULL)
+    if (upng->mapping != NULL)
+    {
+        munmap(upng->mapping, upng->mapping_size);
+    }
+    else if (upng->buffer != NULL)
     {
         free(upng->buffer);
     }
@@ -61,6 +61,9 @@ typedef struct upng_t upng_t;
 
 upng_t *upng_new_from_bytes(const unsigned char *buffer, unsigned long size);
 upng_t *upng_new_from_file(const char *path);
+/* wrap 8 bit RGBA pixels stored at offset in a mmap'd region; the image
+ * takes ownership of the mapping and unmaps it in upng_free */
+upng_t *upng_new_from_mapped_pixels(void *mapping, unsigned long mapping_size, unsigned long offset, unsigned width, unsigned height);
 void upng_free(upng_t *upng);
 
 upng_error upng_header(upng_t *upng);
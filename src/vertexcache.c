@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vertexcache.h"
+#include "array.h"
+#include "trace.h"
+
+static bool optimization_enabled = true;
+
+void init_vertex_cache_optimization(bool enabled)
+{
+    optimization_enabled = enabled;
+}
+
+bool is_vertex_cache_optimization_enabled(void)
+{
+    return optimization_enabled;
+}
+
+float compute_acmr(const face_t *faces)
+{
+    int num_faces = array_length((void *)faces);
+    if (num_faces == 0)
+        return 0;
+
+    int fifo[ACMR_CACHE_SIZE];
+    int fifo_size = 0;
+    int fifo_next = 0;
+    int num_misses = 0;
+    for (int i = 0; i < num_faces; i++)
+    {
+        int corners[3] = {faces[i].a, faces[i].b, faces[i].c};
+        for (int j = 0; j < 3; j++)
+        {
+            bool hit = false;
+            for (int k = 0; k < fifo_size && !hit; k++)
+                hit = fifo[k] == corners[j];
+            if (hit)
+                continue;
+
+            num_misses++;
+            fifo[fifo_next] = corners[j];
+            fifo_next = (fifo_next + 1) % ACMR_CACHE_SIZE;
+            if (fifo_size < ACMR_CACHE_SIZE)
+                fifo_size++;
+        }
+    }
+    return (float)num_misses / num_faces;
+}
+
+////////////////////////////////////////////////////////////////////
+// Forsyth's vertex score: vertices of the last face drawn get a fixed
+// score, older cache entries fade with their position, and vertices
+// with few faces left get a boost so they are finished off quickly
+// instead of leaving isolated faces behind.
+////////////////////////////////////////////////////////////////////
+static float get_vertex_score(int cache_position, int remaining_faces)
+{
+    if (remaining_faces == 0)
+        return -1;
+
+    float score = 0;
+    if (cache_position >= 0 && cache_position < 3)
+    {
+        score = 0.75f;
+    }
+    else if (cache_position >= 3)
+    {
+        float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+        score = powf(1.0f - (cache_position - 3) * scaler, 1.5f);
+    }
+    return score + 2.0f / sqrtf(remaining_faces);
+}
+
+typedef struct
+{
+    int *remaining;      // Faces of the current range not emitted yet, per vertex
+    int *cache_position; // Position in the modelled LRU cache, -1 when not in it
+    float *score;
+    int cache[VERTEX_CACHE_SIZE + 3];
+    int cache_size;
+} vertex_cache_state_t;
+
+static void update_vertex_score(vertex_cache_state_t *state, int v)
+{
+    state->score[v] = get_vertex_score(state->cache_position[v], state->remaining[v]);
+}
+
+////////////////////////////////////////////////////////////////////
+// Greedy reorder of a face range, always emitting the face with the
+// highest vertex score sum. Meshlets are small enough that rescoring
+// every face of the range at each step is cheap; the cache carries
+// over from one range to the next.
+////////////////////////////////////////////////////////////////////
+static void optimize_face_range(face_t *faces, int first, int count, vertex_cache_state_t *state, face_t *scratch)
+{
+    bool emitted[MESHLET_MAX_FACES] = {false};
+    face_t *range = &faces[first];
+
+    for (int i = 0; i < count; i++)
+    {
+        state->remaining[range[i].a]++;
+        state->remaining[range[i].b]++;
+        state->remaining[range[i].c]++;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        update_vertex_score(state, range[i].a);
+        update_vertex_score(state, range[i].b);
+        update_vertex_score(state, range[i].c);
+    }
+
+    for (int n = 0; n < count; n++)
+    {
+        int best = -1;
+        float best_score = -INFINITY;
+        for (int i = 0; i < count; i++)
+        {
+            if (emitted[i])
+                continue;
+            float score = state->score[range[i].a] + state->score[range[i].b] + state->score[range[i].c];
+            if (score > best_score)
+            {
+                best_score = score;
+                best = i;
+            }
+        }
+
+        emitted[best] = true;
+        scratch[n] = range[best];
+        int corners[3] = {range[best].a, range[best].b, range[best].c};
+
+        // The face vertices move to the front of the cache, pushing the others back
+        int new_cache[VERTEX_CACHE_SIZE + 3];
+        int new_size = 0;
+        for (int j = 0; j < 3; j++)
+        {
+            new_cache[new_size++] = corners[j];
+            state->remaining[corners[j]]--;
+        }
+        for (int k = 0; k < state->cache_size; k++)
+        {
+            int v = state->cache[k];
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                new_cache[new_size++] = v;
+        }
+        for (int k = 0; k < new_size; k++)
+        {
+            int v = new_cache[k];
+            state->cache_position[v] = k < VERTEX_CACHE_SIZE ? k : -1;
+            update_vertex_score(state, v);
+        }
+        state->cache_size = new_size < VERTEX_CACHE_SIZE ? new_size : VERTEX_CACHE_SIZE;
+        memcpy(state->cache, new_cache, sizeof(int) * state->cache_size);
+    }
+
+    memcpy(range, scratch, sizeof(face_t) * count);
+}
+
+// Number the vertices in the order the faces first use them, unused ones last
+static void reorder_vertices(mesh_t *mesh)
+{
+    int num_vertices = array_length(mesh->vertices);
+    int *remap = (int *)malloc(sizeof(int) * num_vertices);
+    for (int v = 0; v < num_vertices; v++)
+        remap[v] = -1;
+
+    int next = 0;
+    for (int l = 0; l < mesh->num_lods; l++)
+    {
+        face_t *faces = mesh->lods[l].faces;
+        for (int i = 0; i < array_length(faces); i++)
+        {
+            if (remap[faces[i].a] < 0)
+                remap[faces[i].a] = next++;
+            if (remap[faces[i].b] < 0)
+                remap[faces[i].b] = next++;
+            if (remap[faces[i].c] < 0)
+                remap[faces[i].c] = next++;
+        }
+    }
+    for (int v = 0; v < num_vertices; v++)
+    {
+        if (remap[v] < 0)
+            remap[v] = next++;
+    }
+
+    vertex_t *reordered = (vertex_t *)malloc(sizeof(vertex_t) * num_vertices);
+    for (int v = 0; v < num_vertices; v++)
+        reordered[remap[v]] = mesh->vertices[v];
+    memcpy(mesh->vertices, reordered, sizeof(vertex_t) * num_vertices);
+
+    for (int l = 0; l < mesh->num_lods; l++)
+    {
+        face_t *faces = mesh->lods[l].faces;
+        for (int i = 0; i < array_length(faces); i++)
+        {
+            faces[i].a = remap[faces[i].a];
+            faces[i].b = remap[faces[i].b];
+            faces[i].c = remap[faces[i].c];
+        }
+    }
+    free(reordered);
+    free(remap);
+}
+
+void optimize_mesh_vertex_order(mesh_t *mesh)
+{
+    int num_vertices = array_length(mesh->vertices);
+    if (num_vertices == 0)
+        return;
+
+    TRACE_BEGIN("optimize_vertex_order");
+    vertex_cache_state_t state;
+    state.remaining = (int *)calloc(num_vertices, sizeof(int));
+    state.cache_position = (int *)malloc(sizeof(int) * num_vertices);
+    state.score = (float *)malloc(sizeof(float) * num_vertices);
+    face_t scratch[MESHLET_MAX_FACES];
+
+    for (int l = 0; l < mesh->num_lods; l++)
+    {
+        for (int v = 0; v < num_vertices; v++)
+            state.cache_position[v] = -1;
+        state.cache_size = 0;
+
+        const mesh_lod_t *lod = &mesh->lods[l];
+        for (int m = 0; m < array_length(lod->meshlets); m++)
+            optimize_face_range(lod->faces, lod->meshlets[m].first_face, lod->meshlets[m].num_faces, &state, scratch);
+    }
+    reorder_vertices(mesh);
+
+    free(state.remaining);
+    free(state.cache_position);
+    free(state.score);
+    TRACE_END("optimize_vertex_order");
+}
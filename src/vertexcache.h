@@ -0,0 +1,31 @@
+#ifndef VERTEXCACHE_H
+#define VERTEXCACHE_H
+
+#include <stdbool.h>
+#include "mesh.h"
+
+////////////////////////////////////////////////////////////////////
+// Load time reordering for vertex locality. Faces inside each meshlet
+// are reordered with Tom Forsyth's linear-speed vertex cache
+// optimisation, so consecutive faces reuse recently transformed
+// vertices; then vertices are renumbered in order of first use so
+// the faces walk the vertex array front to back.
+//
+// ACMR (average cache miss ratio) is the number of vertices a face
+// misses in a FIFO cache of ACMR_CACHE_SIZE entries, averaged over the
+// faces: 3 is no reuse at all, about 0.5 is the best a closed mesh
+// can reach.
+////////////////////////////////////////////////////////////////////
+#define VERTEX_CACHE_SIZE 32 // LRU cache modelled by the face scoring
+#define ACMR_CACHE_SIZE 16   // FIFO cache the ACMR is measured with
+
+void init_vertex_cache_optimization(bool enabled);
+
+bool is_vertex_cache_optimization_enabled(void);
+
+float compute_acmr(const face_t *faces);
+
+// Reorder the faces of every level and meshlet, then the vertices
+void optimize_mesh_vertex_order(mesh_t *mesh);
+
+#endif